@@ -0,0 +1,40 @@
+#ifndef BATCH_COMPILER_H
+#define BATCH_COMPILER_H
+
+#include <string>
+#include <vector>
+
+#include <compiler.hpp>
+
+namespace carto {
+
+// One project of a batch compile and how its compile went.
+struct batch_job {
+    std::string input;
+    std::string output;
+
+    // empty when the map was written
+    std::string error;
+    std::vector<std::string> warnings;
+    double ms;
+
+    batch_job(std::string const& input_ = "", std::string const& output_ = "")
+      : input(input_), output(output_), error(), warnings(), ms(0) { }
+};
+
+// The jobs of a manifest: one "input.[mml|mss] output.xml" pair per line,
+// blank lines and lines starting with # skipped. Relative paths resolve
+// against the directory of the manifest. config_error on a malformed line.
+std::vector<batch_job> read_manifest(std::string const& filename);
+
+// Compile every job with options on a pool of jobs threads, one per core
+// when 0, writing each map to its output. A failing job only records its
+// error; the others go on. Returns the number of failed jobs. Datasource
+// plugins must have been registered, options.cache and
+// options.datasources are shared by all jobs when set.
+std::size_t compile_batch(std::vector<batch_job>& jobs, compile_options const& options,
+                          unsigned threads = 0);
+
+}
+
+#endif
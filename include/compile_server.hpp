@@ -0,0 +1,112 @@
+#ifndef COMPILE_SERVER_H
+#define COMPILE_SERVER_H
+
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <compiler.hpp>
+#include <utility/thread_pool.hpp>
+
+namespace carto {
+
+// Compiles maps for clients of a Unix domain socket, keeping the
+// datasource pool and parse cache of its options warm between requests.
+// Connections wait for requests, read inline sources and write answers
+// on the accepting thread; only compiles take a pool thread. An inline
+// source longer than max_source is answered with an error and the
+// connection closed, as is one not sent within read_timeout seconds.
+//
+// A connection carries any number of requests, each one line
+//
+//   mml <path>                      compile the MML file at path
+//   mss <path>                      compile the carto file at path
+//   mml-source <length> <path>      compile the MML source that follows
+//   mss-source <length> <path>      compile the carto source that follows
+//
+// where path also resolves relative file names for inline sources. The
+// answer is either
+//
+//   ok <length> <warnings>          then one line per warning, then
+//                                   length bytes of map xml
+//   error <length>                  then length bytes of message
+class compile_server : private boost::noncopyable {
+public:
+    typedef boost::asio::local::stream_protocol protocol;
+
+    // listen on socket_path, replacing whatever is there
+    compile_server(std::string const& socket_path, compile_options const& options,
+                   unsigned jobs = 0, std::size_t max_source = 64 << 20,
+                   unsigned read_timeout = 30);
+
+    ~compile_server();
+
+    // serve until SIGINT or SIGTERM
+    void run();
+
+    // the answer to one request, the body being the source of the
+    // -source requests
+    std::string respond(std::string const& request, std::string const& body);
+
+    std::size_t requests() const;
+
+private:
+    struct connection {
+        protocol::socket socket;
+        boost::asio::streambuf buffer;
+        boost::asio::deadline_timer timer;
+
+        // the request being served and the answer being written
+        std::string request;
+        std::string answer;
+
+        connection(boost::asio::io_service& io)
+          : socket(io), buffer(), timer(io), request(), answer() { }
+    };
+
+    typedef boost::shared_ptr<connection> connection_ptr;
+
+    void accept();
+
+    void handle_accept(connection_ptr conn, boost::system::error_code const& error);
+
+    void read_request(connection_ptr conn);
+
+    void handle_request(connection_ptr conn, boost::system::error_code const& error);
+
+    void handle_source(connection_ptr conn, std::size_t length,
+                       boost::system::error_code const& error);
+
+    void handle_timeout(connection_ptr conn);
+
+    // on a pool thread, with length bytes of source in the buffer
+    void serve(connection_ptr conn, std::size_t length);
+
+    void write_answer(connection_ptr conn, std::string const& answer, bool keep_open);
+
+    void handle_write(connection_ptr conn, bool keep_open,
+                      boost::system::error_code const& error);
+
+    static std::string error_answer(std::string const& message);
+
+    void stop();
+
+    std::string socket_path_;
+    compile_options options_;
+    std::size_t max_source_;
+    unsigned read_timeout_;
+    boost::asio::io_service io_;
+    protocol::acceptor acceptor_;
+    boost::asio::signal_set signals_;
+    thread_pool pool_;
+
+    mutable boost::mutex mutex_;
+    std::size_t requests_;
+};
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <mapnik/map.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <datasource_pool.hpp>
+#include <parse_cache.hpp>
+#include <style_variant.hpp>
+
+namespace carto {
+
+// What the carto command line options set, for compiling in-process.
+struct compile_options {
+    bool strict;
+    bool lazy_datasources;
+    bool infer_zooms;
+    bool project_columns;
+    bool prune_rules;
+    bool merge_zooms;
+    bool fold_values;
+    bool share_styles;
+    bool order_filters;
+
+    // features per layer sampled for filter selectivity and rule match
+    // counts, as carto --sample-filters and --profile-data; 0 to not look
+    // at the data. sample_limit orders filters by cost like order_filters.
+    std::size_t sample_limit, profile_limit;
+
+    // @variable values forced over the stylesheets' own
+    style_variant const* variant;
+
+    // stylesheet sources by the name the MML uses for them, looked up
+    // before the file system
+    std::map<std::string, std::string> sources;
+
+    // shared between compiles when set, one pool per compile otherwise
+    boost::shared_ptr<datasource_pool> datasources;
+
+    // when set, sources are parsed through it
+    boost::shared_ptr<parse_cache> cache;
+
+    unsigned width, height;
+
+    compile_options();
+};
+
+struct compile_result {
+    mapnik::Map map;
+
+    // what the command line prints as ### WARNING: lines
+    std::vector<std::string> warnings;
+
+    compile_result(unsigned width, unsigned height) : map(width, height), warnings() { }
+};
+
+// Compile MML or carto source held in memory. Relative stylesheet and
+// datasource file names resolve against the directory of path. Nothing is
+// written to stdout or stderr, warnings of sampling included; datasource
+// plugins must have been registered with mapnik beforehand. Errors of
+// every kind are thrown as config_error. Stylesheets alone have no data
+// to sample.
+//
+// Compiles can run at once on different threads with lazy_datasources
+// and without project_columns or sampling. Otherwise datasources are
+// created, and with project_columns or sampling read, through mapnik's
+// datasource_cache by plugins that aren't safe to use from several
+// threads at once; sampling creates them even with lazy_datasources.
+// Under carto --alloc-stats every thread's allocations are counted
+// together.
+compile_result compile_mml(std::string const& in, std::string const& path,
+                           compile_options const& options = compile_options());
+
+compile_result compile_mss(std::string const& in, std::string const& path,
+                           compile_options const& options = compile_options());
+
+}
+
+#endif
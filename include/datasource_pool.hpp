@@ -0,0 +1,47 @@
+#ifndef DATASOURCE_POOL_H
+#define DATASOURCE_POOL_H
+
+#include <map>
+#include <string>
+
+#include <mapnik/params.hpp>
+#include <mapnik/datasource.hpp>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace carto {
+
+// Datasource instances keyed by their parameter set, so layers pointing at
+// the same source with the same parameters share one mapnik::datasource
+// (and one set of file handles). Keys compare every parameter, so the
+// parameters saved for a layer never change by being shared.
+class datasource_pool : private boost::noncopyable {
+public:
+    datasource_pool();
+
+    // return the pooled datasource for params, creating it on first use.
+    // lazy hands out a deferred_datasource rather than a plugin instance.
+    mapnik::datasource_ptr get(mapnik::parameters const& params, bool lazy = false);
+
+    // number of distinct datasources created
+    std::size_t size() const;
+
+    // number of requests answered with an already existing datasource
+    std::size_t shared() const;
+
+    void clear();
+
+    static std::string key(mapnik::parameters const& params);
+
+private:
+    typedef std::map<std::string, mapnik::datasource_ptr> pool_type;
+
+    mutable boost::mutex mutex_;
+    pool_type pool_;
+    std::size_t shared_;
+};
+
+}
+
+#endif
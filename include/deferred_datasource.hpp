@@ -0,0 +1,52 @@
+#ifndef DEFERRED_DATASOURCE_H
+#define DEFERRED_DATASOURCE_H
+
+#include <string>
+#include <vector>
+
+#include <mapnik/map.hpp>
+#include <mapnik/params.hpp>
+#include <mapnik/datasource.hpp>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace carto {
+
+// Stand-in datasource that only carries its parameters. The real plugin
+// datasource is created the first time something asks for features,
+// extents or a descriptor, so writing XML never touches files or
+// connections. params() is the untouched parameter set, which is all
+// save_map needs.
+class deferred_datasource : public mapnik::datasource {
+public:
+    explicit deferred_datasource(mapnik::parameters const& params);
+
+    virtual ~deferred_datasource();
+
+    // create (and bind) the underlying datasource if it doesn't exist yet
+    mapnik::datasource_ptr get() const;
+
+    bool created() const;
+
+    virtual void bind() const;
+    virtual int type() const;
+    virtual mapnik::featureset_ptr features(mapnik::query const& q) const;
+    virtual mapnik::featureset_ptr features_at_point(mapnik::coord2d const& pt) const;
+    virtual mapnik::box2d<double> envelope() const;
+    virtual mapnik::layer_descriptor get_descriptor() const;
+
+private:
+    mutable boost::mutex mutex_;
+    mutable mapnik::datasource_ptr ds_;
+};
+
+// Force creation and binding of every layer datasource in the map, using
+// up to `jobs` worker threads. Layers sharing a datasource (see
+// datasource_pool) bind it once, from a single thread. Returns one
+// message per failing layer, in layer order.
+std::vector<std::string> validate_datasources(mapnik::Map const& map, unsigned jobs = 1);
+
+}
+
+#endif
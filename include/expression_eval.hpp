@@ -6,6 +6,7 @@
 #include <utility/utree.hpp>
 #include <utility/environment.hpp>
 #include <utility/carto_functions.hpp>
+#include <utility/stats.hpp>
 
 #include <parse/expression_grammar.hpp>
 
@@ -18,8 +19,10 @@ struct expression {
     utree const& tree;
     annotations_type const& annotations;
     style_env const& env;
+    compile_stats *stats;
     
-    expression(utree const& tree_, annotations_type const& annotations_, style_env const& env_);
+    expression(utree const& tree_, annotations_type const& annotations_, style_env const& env_,
+               compile_stats *stats_ = 0);
     
     template<class T>
     T as(utree const& ut)
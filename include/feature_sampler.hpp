@@ -0,0 +1,55 @@
+#ifndef FEATURE_SAMPLER_H
+#define FEATURE_SAMPLER_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/expression_node.hpp>
+
+#include <intermediate/mss_to_mapnik.hpp>
+
+namespace carto {
+
+typedef std::vector<mapnik::feature_ptr> feature_sample;
+
+// Read up to `limit` features, with all their attributes, from a layer's
+// datasource. Datasource errors give an empty sample and are reported as
+// ### WARNING: lines on log, when it is set.
+feature_sample sample_features(mapnik::layer const& lyr, std::size_t limit,
+                               std::ostream* log);
+
+// Evaluate a filter expression on a feature the way the renderer would.
+bool feature_matches(mapnik::expression_ptr const& expr, mapnik::Feature const& feature);
+
+// One sample per map layer, in layer order.
+std::vector<feature_sample> sample_layers(mapnik::Map const& map, std::size_t limit,
+                                          std::ostream* log);
+
+// For every condition the generator recorded per style, the fraction of
+// features passing it, over samples of the layers using that style.
+intermediate::selectivity_type
+sample_selectivity(mapnik::Map const& map,
+                   intermediate::conditions_type const& conditions,
+                   std::size_t limit,
+                   std::ostream* log);
+
+// How often each rule's filter matches the sampled features of the layers
+// using its style, counted once per zoom level the rule is active at.
+// names gives the selector of each rule, as recorded by the generator.
+intermediate::rule_hits_type
+count_rule_matches(mapnik::Map const& map,
+                   intermediate::rule_names_type const& names,
+                   std::vector<feature_sample> const& samples);
+
+// The average number of rule filters the renderer evaluates per sampled
+// feature and zoom level, stopping at the first match in each style.
+double filter_evaluations(mapnik::Map const& map,
+                          std::vector<feature_sample> const& samples);
+
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef INTERMEDIATE_ATTRIBUTE_COLLECTOR_H_
+#define INTERMEDIATE_ATTRIBUTE_COLLECTOR_H_
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <intermediate/types.hpp>
+
+namespace carto { namespace intermediate {
+    // Collects, per generated style name, every feature attribute the
+    // style's rules can read: filter keys and the [field] references in
+    // expression valued attributes (text-name, shield-name,
+    // building-height and the *-file path expressions).
+    class attribute_collector : public visitor {
+    public:
+        typedef std::set<std::string> attribute_set;
+        typedef std::map<std::string, attribute_set> styles_type;
+
+    private:
+        styles_type &styles;
+
+        void collect_fields(std::string const& expr, attribute_set &attrs);
+
+    public:
+        attribute_collector(styles_type &);
+
+        static bool is_expression_key(std::string const& key);
+
+        virtual void visit(stylesheet const&);
+        virtual void visit(rule const&);
+    };
+} }
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef INTERMEDIATE_FILTER_ANALYSIS_H_
+#define INTERMEDIATE_FILTER_ANALYSIS_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <intermediate/types.hpp>
+
+namespace carto { namespace intermediate {
+
+// What the filters of one rule say about one key: a numeric interval,
+// at most one required value and any number of excluded values. Keys
+// compared against non-numeric values with anything but = and != are
+// "opaque" and only ever reasoned about filter by filter.
+struct key_constraint {
+    struct bound {
+        double value;
+        bool closed;
+
+        bound(double v = 0, bool c = true) : value(v), closed(c) { }
+    };
+
+    bound lower, upper;
+    bool has_eq;
+    utree eq;
+    std::vector<utree> neq;
+    bool conflict;
+    bool opaque;
+    bool integral;
+    std::vector<filter_selector> filters;
+
+    key_constraint();
+
+    // zoom levels are whole numbers, which makes e.g. [zoom>3][zoom<4] empty
+    static bool is_integral_key(std::string const& key);
+
+    void add(filter_selector const& filter);
+
+    bool numeric_eq() const;
+
+    // the interval after folding in the required value and, for integral
+    // keys, rounding to whole numbers
+    std::pair<bound, bound> interval() const;
+
+    bool satisfiable() const;
+
+    // every value allowed by this constraint is allowed by other
+    bool implies(key_constraint const& other) const;
+};
+
+typedef std::map<std::string, key_constraint> constraints_type;
+
+constraints_type analyse_filters(rule::filters_type const& filters);
+
+bool filters_satisfiable(rule::filters_type const& filters);
+
+// true when some feature can be matched by both lhs and rhs
+bool filters_compatible(rule::filters_type const& lhs, rule::filters_type const& rhs);
+
+// true when every feature matched by lhs is also matched by rhs
+bool filters_imply(rule::filters_type const& lhs, rule::filters_type const& rhs);
+
+} }
+
+#endif
@@ -9,6 +9,10 @@
 #include <parse/parse_tree.hpp>
 
 #include <utility/environment.hpp>
+#include <utility/stats.hpp>
+#include <utility/trace.hpp>
+
+#include <style_variant.hpp>
 
 namespace carto { namespace intermediate {
 
@@ -23,6 +27,16 @@ struct mss_parser {
     bool strict;
     std::string path;
     
+    // when set, the variant's variables replace the stylesheet's own
+    // definitions of them, at any nesting level
+    style_variant const* variant;
+    
+    // timings and counts of this parse, when set
+    compile_stats *stats;
+    
+    // evaluate and cascade events of this stylesheet, when set
+    compile_trace *trace;
+    
     mss_parser(parse_tree const& pt, bool strict_ = false,
                std::string const& path_ = "./");
       
@@ -69,6 +83,9 @@ struct mss_parser {
     void parse_variable(utree const& node, style_env& env);
 
     void parse_map_style(stylesheet &styl, utree const& node, style_env& env);
+
+    // copy a value from another parse tree, giving it annotations in ours
+    utree import_value(utree const& value, annotations_type const& from);
   
     static mss_parser load(std::string filename, bool strict);  
 };
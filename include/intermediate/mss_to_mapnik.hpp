@@ -2,24 +2,128 @@
 #define INTERMEDIATE_GENERATOR_H_
 
 #include <intermediate/types.hpp>
+#include <utility/stats.hpp>
 
 #include <mapnik/map.hpp>
 #include <mapnik/rule.hpp>
 
 #include <boost/optional.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <map>
+#include <set>
+#include <vector>
+#include <iosfwd>
 
 namespace carto { namespace intermediate {
-    class generation_error : std::runtime_error {
+    class generation_error : public std::runtime_error {
     public:
         generation_error(std::string const& msg) : std::runtime_error(msg) { }
         virtual ~generation_error() throw() { }
     };
 
+    // order of the conditions and-ed together in a rule's filter
+    enum filter_order {
+        order_by_key,   // filter_selector::comparator order
+        order_by_cost   // cheapest comparisons first
+    };
+
+    // fraction of sampled features passing each emitted condition, keyed
+    // by the condition's expression text
+    typedef std::map<std::string, double> selectivity_type;
+
+    // the conditions emitted per style, as expression text
+    typedef std::map<std::string, std::set<std::string> > conditions_type;
+
+    // the selector of each Mapnik rule per style, in rule order
+    typedef std::map<std::string, std::vector<std::string> > rule_names_type;
+
+    // how many sampled features each rule (by selector) matched, per style
+    typedef std::map<std::string, std::map<std::string, std::size_t> > rule_hits_type;
+
+    // how many generated rules carry each symbolizer, keyed by the
+    // symbolizer's content
+    typedef boost::unordered_map<std::string, std::size_t> symbolizer_counts_type;
+
+    // per style, a description of everything the style renders (empty for
+    // styles this generator didn't produce on its own); styles with equal
+    // non-empty signatures are interchangeable
+    typedef std::map<std::string, std::string> style_signatures_type;
+
+    // zoom levels 0 to zoom_levels - 1 have a scale denominator range,
+    // [first, second) as mapnik rules apply it
+    unsigned const zoom_levels = 23;
+    std::pair<double, double> zoom_scale_range(unsigned zoom);
+
     class mss_to_mapnik : public visitor {
     private:
         mapnik::Map &map_;
         boost::optional<mapnik::rule> rule_;
 
+        // one condition of a rule filter, with what it's ordered by
+        struct emitted_filter {
+            unsigned cost;
+            double selectivity;
+            std::string expr;
+
+            emitted_filter(unsigned c, double s, std::string const& e)
+              : cost(c), selectivity(s), expr(e) { }
+
+            bool operator<(emitted_filter const& rhs) const {
+                if (cost != rhs.cost) return cost < rhs.cost;
+                return selectivity < rhs.selectivity;
+            }
+        };
+
+        // a rule already added to a style, kept around so later rules
+        // differing only in their zoom range can be folded into it
+        struct emitted_rule {
+            std::string selector;           // of the first source
+            rule::filters_type filters;     // everything but zoom
+            rule::attributes_type attrs;
+            double min_zoom, max_zoom;
+            std::size_t index;              // in the style's rules
+            std::vector<rule::filters_type> sources;
+            // equality conditions on one key, any of which has to hold
+            std::vector<filter_selector> alternatives;
+        };
+
+        typedef std::map<std::string, std::vector<emitted_rule> > emitted_type;
+
+        bool merge_zooms_;
+        emitted_type emitted_;
+        std::size_t merged_;
+
+        bool track_rule(mapnik::feature_type_style &style, rule const& rule);
+        bool fold_value(mapnik::feature_type_style &style, emitted_rule &prev,
+                        emitted_rule const& current);
+        static bool exclusive(emitted_rule const& lhs, emitted_rule const& rhs);
+        std::size_t rule_hits(std::string const& style, emitted_rule const& rule) const;
+        void reorder_rules(std::string const& name, std::vector<emitted_rule> &emitted);
+
+        filter_order filter_order_;
+        selectivity_type const* selectivity_;
+        conditions_type *conditions_;
+        std::vector<std::string> rule_conditions_;
+
+        bool fold_values_;
+        std::size_t folded_;
+
+        rule_names_type *rule_names_;
+        rule_hits_type const* rule_hits_;
+        std::size_t reordered_;
+
+        symbolizer_counts_type *symbolizers_;
+        style_signatures_type *signatures_;
+        std::set<std::string> touched_;
+
+        std::ostream *log_;
+        compile_stats *stats_;
+
+        mapnik::expression_ptr parse_expression(std::string const& str);
+
+        void sign_style(std::string const& name);
+
         template<class symbolizer>
         inline symbolizer init_symbolizer() 
         {
@@ -58,9 +162,62 @@ namespace carto { namespace intermediate {
 
         void emit_map_style(stylesheet::map_style_type const&);
         void emit_filters(rule::filters_type const&);
+        emitted_filter make_condition(unsigned cost, std::string const& expr) const;
+        mapnik::expression_ptr build_filter(std::vector<emitted_filter> &conditions);
 
     public:
-        explicit mss_to_mapnik(mapnik::Map &m);
+        // with merge_zooms, a rule with the same attributes and non-zoom
+        // filters as one emitted before it into the same style, and a zoom
+        // range adjacent to that rule's, widens the earlier rule instead
+        // of adding its own
+        explicit mss_to_mapnik(mapnik::Map &m, bool merge_zooms = false);
+
+        // rules folded into others so far
+        std::size_t merged_rules() const;
+
+        // with fold_values, a rule with the same attributes and zoom range
+        // as one emitted before it into the same style, whose filters
+        // differ from that rule's in one [key=value] only, turns the
+        // earlier rule's condition into ([key=value] or [key=other])
+        void set_fold_values(bool fold_values);
+
+        // rules folded into disjunctions so far
+        std::size_t folded_rules() const;
+
+        // with order_by_cost, numeric comparisons go before string
+        // equality, before anything else; conditions of the same cost are
+        // ordered most selective first when selectivity is given
+        void set_filter_order(filter_order order, selectivity_type const* selectivity = 0);
+
+        // record every emitted condition into conditions
+        void record_conditions(conditions_type *conditions);
+
+        // record the selector of every Mapnik rule added into names
+        void record_rules(rule_names_type *names);
+
+        // once all rules are emitted, move the rules that matched more
+        // sampled features ahead of those that matched fewer, where no
+        // feature can match both
+        void set_rule_hits(rule_hits_type const* hits);
+
+        // rules moved by set_rule_hits
+        std::size_t reordered_rules() const;
+
+        // count the symbolizers of every Mapnik rule added into counts
+        void record_symbolizers(symbolizer_counts_type *counts);
+
+        // record the signature of every style touched into signatures
+        void record_signatures(style_signatures_type *signatures);
+
+        // where warnings go, std::clog unless set; 0 drops them
+        void set_log(std::ostream *log);
+
+        // count mapnik expressions parsed into stats
+        void set_stats(compile_stats *stats);
+
+        // the content key of the symbolizer generated from the given
+        // attributes, one per symbolizer type present
+        static std::vector<std::string> symbolizer_keys(rule::attributes_type const& attrs);
 
         virtual void visit(stylesheet const&);
         virtual void visit(rule const&);
@@ -0,0 +1,46 @@
+#ifndef INTERMEDIATE_RULE_PRUNER_H_
+#define INTERMEDIATE_RULE_PRUNER_H_
+
+#include <string>
+#include <vector>
+
+#include <intermediate/types.hpp>
+
+namespace carto { namespace intermediate {
+    // Removes the rules of a cascaded stylesheet that can never produce
+    // output: rules without attributes, rules whose filters contradict
+    // each other and rules that, with the FILTER_FIRST styles
+    // mss_to_mapnik generates, only ever see features an earlier rule of
+    // the same style has already taken.
+    class rule_pruner {
+    public:
+        enum reason_type {
+            empty,
+            unsatisfiable,
+            shadowed
+        };
+
+        struct removal {
+            std::string selector;
+            reason_type reason;
+            std::string shadowed_by;
+
+            removal(std::string const& s, reason_type r, std::string const& by = "")
+              : selector(s), reason(r), shadowed_by(by) { }
+
+            std::string get_string() const;
+        };
+
+        typedef std::vector<removal> report_type;
+
+    private:
+        report_type &report;
+
+    public:
+        rule_pruner(report_type &);
+
+        void prune(stylesheet &styl);
+    };
+} }
+
+#endif
@@ -10,6 +10,7 @@
 
 #include <iosfwd>
 #include <sstream>
+#include <map>
 
 #include <mapnik/map.hpp>
 #include <mapnik/layer.hpp>
@@ -19,11 +20,14 @@
 #include <mapnik/datasource_cache.hpp>
 
 #include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <mss_parser.hpp>
-#include <parse/parse_tree.hpp>
-#include <parse/json_grammar.hpp>
+#include <datasource_pool.hpp>
+#include <style_variant.hpp>
+#include <parse_cache.hpp>
+#include <parse/mml_reader.hpp>
 #include <utility/utree.hpp>
 
 namespace carto {
@@ -33,12 +37,90 @@ namespace al = boost::algorithm;
 
 struct mml_parser {
 
-    parse_tree tree;
+    mml_document document;
     bool strict;
     std::string path;
     std::vector< std::vector<std::string> > layer_selectors;
     
-    mml_parser(parse_tree const& pt, bool strict_ = false, std::string const& path_ = "./");
+    // hand layers a deferred_datasource instead of creating the plugin
+    // datasource while compiling
+    bool lazy_datasources;
+    
+    // layers with identical datasource parameters share one instance; the
+    // pool lives for one compile unless the caller hands in its own
+    boost::shared_ptr<datasource_pool> datasources;
+    
+    // fill in minzoom/maxzoom the MML leaves out from the scale ranges of
+    // the rules that can apply to each layer
+    bool infer_zooms;
+    
+    // per layer: whether the MML gave minzoom, maxzoom
+    std::vector< std::pair<bool, bool> > layer_zooms_given;
+    
+    // passed on to every stylesheet, see carto::mss_parser
+    bool prune_rules;
+    intermediate::rule_pruner::report_type pruned_rules;
+    bool merge_zooms;
+    std::size_t merged_rules;
+    bool fold_values;
+    std::size_t folded_rules;
+    intermediate::filter_order filter_order;
+    intermediate::selectivity_type const* selectivity;
+    intermediate::conditions_type *conditions;
+    intermediate::rule_names_type *rule_names;
+    intermediate::rule_hits_type const* rule_hits;
+    std::size_t reordered_rules;
+    intermediate::symbolizer_counts_type *symbolizers;
+    
+    // layers of styles that render exactly the same as another style
+    // use that style instead, and the duplicate is removed
+    bool share_styles;
+    intermediate::style_signatures_type style_signatures;
+    
+    // removed style, style used instead
+    std::vector< std::pair<std::string, std::string> > shared_styles;
+    
+    // restrict SQL datasources to the feature attributes the layer's
+    // styles actually read, of the columns their table has. Finding out
+    // which those are binds one datasource per table.
+    bool project_columns;
+    
+    // attributes read per style, collected while parsing stylesheets
+    intermediate::attribute_collector::styles_type style_attributes;
+    
+    // datasources are created once every layer has its styles, so their
+    // parameters can still be adjusted per layer
+    struct datasource_def {
+        bool defined;
+        mapnik::parameters params;
+        source_location location;
+        
+        datasource_def() : defined(false), params(), location() { }
+    };
+    
+    std::vector<datasource_def> layer_datasources;
+    
+    // stylesheets parsed ahead of parse_map by load_stylesheets, so copies
+    // of this parser compile them without parsing them again
+    std::vector<mss_parser> stylesheets;
+    
+    // @variable values forced over the stylesheets' own
+    style_variant const* variant;
+    
+    // stylesheet sources by the name the MML uses for them, looked up
+    // before the file system
+    std::map<std::string, std::string> const* sources;
+    
+    // when set, stylesheets are parsed through it
+    parse_cache *cache;
+    
+    // see carto::mss_parser
+    std::ostream *log;
+    std::ostream *dump;
+    compile_stats *stats;
+    compile_trace *trace;
+    
+    mml_parser(mml_document const& doc, bool strict_ = false, std::string const& path_ = "./");
       
     mml_parser(std::string const& in, bool strict_ = false, std::string const& path_ = "./");
     
@@ -48,24 +130,34 @@ struct mml_parser {
         return detail::as<T>(ut);
     }
     
-    parse_tree get_parse_tree();
-
     std::string get_path();
     
-    node_type get_node_type(utree const& ut);
+    void key_error(mml_member const& member);
     
-    source_location get_location(utree const& ut);
+    void parse_map(mapnik::Map& map);
     
-    void key_error(std::string const& key, utree const& node);
+    // the entries begin to end of document.stylesheets, one Stylesheet
+    // array, sharing their variables
+    void parse_stylesheet(mapnik::Map& map, std::size_t begin, std::size_t end);
     
-    void parse_map(mapnik::Map& map);
+    void load_stylesheets();
     
-    void parse_stylesheet(mapnik::Map& map, utree const& node);
+    // a stylesheet entry is a file name, relative to the MML or not, or
+    // inline carto source
+    mss_parser load_stylesheet(std::string const& data);
     
-    void parse_layer(mapnik::Map& map, utree const& node);
+    void parse_layer(mapnik::Map& map, mml_layer const& layer);
+
+
+    void parse_Datasource(mapnik::parameters& params, std::vector<mml_member> const& members);
 
+    void create_datasource(mapnik::layer& lyr, datasource_def const& def);
 
-    void parse_Datasource(mapnik::layer& lyr, utree const& node);
+    void share_duplicate_styles(mapnik::Map& map);
+
+    void project_layer_columns(mapnik::Map const& map);
+
+    void infer_layer_zooms(mapnik::Map& map);
 
     std::string ensure_relative_to_xml( boost::optional<std::string> opt_path );
     
@@ -76,9 +168,18 @@ struct mml_parser {
 
 mml_parser load_mml(std::string filename, bool strict);
 
-/*
+// Compile the map base describes once per variant, in parallel on up to
+// jobs threads (0: one per core). The MML and stylesheets are parsed once;
+// each variant repeats only variable evaluation, the cascade and style
+// generation, with base's options, into a copy of base. maps holds one
+// map per variant, set up as the caller wants it; errors[i] is empty when
+// variants[i] compiled.
+std::vector<std::string> compile_variants(mml_parser const& base,
+                                          std::vector<style_variant> const& variants,
+                                          std::vector<mapnik::Map>& maps,
+                                          unsigned jobs = 0);
+
 mml_parser load_mml_string(std::string const& in, bool strict, std::string const& base_url);
-*/
 
 }
 #endif 
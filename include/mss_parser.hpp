@@ -41,10 +41,15 @@
 #include <utility/environment.hpp>
 #include <utility/version.hpp>
 #include <utility/round.hpp>
+#include <utility/stats.hpp>
+#include <utility/trace.hpp>
+#include <style_variant.hpp>
 
 
 #include <intermediate/mss_parser.hpp>
 #include <intermediate/mss_to_mapnik.hpp>
+#include <intermediate/attribute_collector.hpp>
+#include <intermediate/rule_pruner.hpp>
 
 namespace carto {
 
@@ -52,6 +57,57 @@ using mapnik::config_error;
 
 struct mss_parser {
     carto::intermediate::mss_parser intermediate_parser;
+    
+    // drop rules that can never match before generating mapnik styles
+    bool prune_rules;
+    carto::intermediate::rule_pruner::report_type pruned;
+    
+    // fold rules differing only in adjacent zoom ranges together
+    bool merge_zooms;
+    std::size_t merged_rules;
+    
+    // fold rules differing only in one [key=value] into a disjunction
+    bool fold_values;
+    std::size_t folded_rules;
+    
+    // how the conditions of each rule filter are ordered, optionally
+    // using sampled selectivity
+    carto::intermediate::filter_order filter_order;
+    carto::intermediate::selectivity_type const* selectivity;
+    
+    // when set, receives the conditions emitted per style
+    carto::intermediate::conditions_type *conditions;
+    
+    // profile guided rule order: rule_names receives the selector of
+    // every generated rule, rule_hits reorders rules by sampled matches
+    carto::intermediate::rule_names_type *rule_names;
+    carto::intermediate::rule_hits_type const* rule_hits;
+    std::size_t reordered_rules;
+    
+    // when set, counts the generated symbolizers by content
+    carto::intermediate::symbolizer_counts_type *symbolizers;
+    
+    // describe every generated style so identical ones can be shared
+    bool sign_styles;
+    carto::intermediate::style_signatures_type signatures;
+    
+    // record which feature attributes each generated style reads
+    bool collect_attributes;
+    carto::intermediate::attribute_collector::styles_type attributes;
+    
+    // @variable values forced over the stylesheet's own
+    style_variant const* variant;
+    
+    // warnings go to log (std::clog unless set, 0 drops them), the
+    // intermediate form of every stylesheet to dump when set
+    std::ostream *log;
+    std::ostream *dump;
+    
+    // timings and counts of this compile, when set
+    compile_stats *stats;
+    
+    // parse, cascade and generate events of this compile, when set
+    compile_trace *trace;
 
     mss_parser(parse_tree const& pt, bool strict_ = false, std::string const& path_ = "./");
       
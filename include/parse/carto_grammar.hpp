@@ -22,6 +22,7 @@
 #include <parse/expression_grammar.hpp>
 #include <parse/error_handler.hpp>
 #include <parse/annotator.hpp>
+#include <parse/skipper.hpp>
 
 namespace carto {
 
@@ -46,14 +47,14 @@ enum carto_node_type
 };
 
 template<typename Iterator>
-struct carto_parser : qi::grammar< Iterator, utree::list_type(), ascii::space_type>
+struct carto_parser : qi::grammar< Iterator, utree::list_type(), skipper>
 {
 
-    qi::rule<Iterator, utree(), ascii::space_type> value, element, filter, //expression, 
+    qi::rule<Iterator, utree(), skipper> value, element, filter, //expression, 
                                                    var_val, expr_val,
                                                    comment, attachment;
                                                    
-    qi::rule<Iterator, utree::list_type(), ascii::space_type> start, variable, attribute, map_style,
+    qi::rule<Iterator, utree::list_type(), skipper> start, variable, attribute, map_style,
                                                        style_prefix, style, name_list, element_list,
                                                        color, mixin, filter_list, expression;
     
@@ -141,7 +142,9 @@ struct carto_parser : qi::grammar< Iterator, utree::list_type(), ascii::space_ty
                   | lexeme['"'  >> *(char_-'"')  > '"' ];
                 
         null = "null" >> qi::attr(spirit::nil); 
-        color =   css_color[_val = css_conv(qi::_1)] > annotate(_val, carto_color);
+        // css_color_grammar skips ascii::space, eps skips comments before it
+        color =   qi::eps >> qi::skip(ascii::space)[css_color[_val = css_conv(qi::_1)]]
+                > annotate(_val, carto_color);
         enum_val = lexeme[+(char_("a-zA-Z_-"))];
         
         var_val = var_name > annotate(_val, carto_variable);
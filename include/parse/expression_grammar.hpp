@@ -10,6 +10,7 @@
 #include <parse/string_grammar.hpp>
 #include <parse/error_handler.hpp>
 #include <parse/annotator.hpp>
+#include <parse/skipper.hpp>
 
 namespace carto {
 
@@ -45,11 +46,11 @@ struct combine_impl
 };
 
 template<typename Iterator>
-struct expression_parser : qi::grammar< Iterator, utree(), ascii::space_type>
+struct expression_parser : qi::grammar< Iterator, utree(), skipper>
 {
     
-    qi::rule<Iterator, utree(), ascii::space_type> expression, term, factor; 
-    qi::rule<Iterator, utree::list_type(), ascii::space_type> function, color, start; 
+    qi::rule<Iterator, utree(), skipper> expression, term, factor; 
+    qi::rule<Iterator, utree::list_type(), skipper> function, color, start; 
     qi::rule<Iterator, boost::spirit::utf8_symbol_type()> name, var_name, function_name;
     
     typedef error_handler_impl<Iterator> error_handler_type;
@@ -90,7 +91,7 @@ struct expression_parser : qi::grammar< Iterator, utree(), ascii::space_type>
         
         factor = ( double_[_val = _1] >> "%" > annotate(_val, exp_percentage) )
                | ( double_[_val = _1] )
-               | ( css_color[_val = css_conv(_1)] > annotate(_val, exp_color) )
+               | ( qi::eps >> qi::skip(ascii::space)[css_color[_val = css_conv(_1)]] > annotate(_val, exp_color) )
                | ( var_name[_val = _1] > annotate(_val, exp_var) )
                | ( function[_val = _1] > annotate(_val, exp_function) )
                | ( "(" > expression[_val = _1] > ")" )
@@ -8,6 +8,7 @@
 #include <parse/expression_grammar.hpp>
 #include <parse/error_handler.hpp>
 #include <parse/annotator.hpp>
+#include <parse/skipper.hpp>
 #include <position_iterator.hpp>
 
 namespace carto {
@@ -39,10 +40,10 @@ enum filter_node_type
 
 
 template<typename Iterator>
-struct filter_parser : qi::grammar< Iterator, utree(), ascii::space_type>
+struct filter_parser : qi::grammar< Iterator, utree(), skipper>
 {
     
-    qi::rule<Iterator, utree(), ascii::space_type> logical_expr, not_expr, cond_expr, 
+    qi::rule<Iterator, utree(), skipper> logical_expr, not_expr, cond_expr, 
                                             equality_expr, lhs_expr, rhs_expr, 
                                             regex_match_expr, regex_replace_expr, 
                                             null, var_attr, var,
@@ -17,6 +17,7 @@
 #include <parse/string_grammar.hpp>
 #include <parse/error_handler.hpp>
 #include <parse/annotator.hpp>
+#include <parse/skipper.hpp>
 
 namespace carto {
 
@@ -35,12 +36,12 @@ enum node_type
 
 
 template<typename Iterator>
-struct json_parser : qi::grammar< Iterator, utree(), ascii::space_type>
+struct json_parser : qi::grammar< Iterator, utree(), skipper>
 {
-    qi::rule<Iterator, utree(), ascii::space_type> start, value;
-    qi::rule<Iterator, utree::list_type(), ascii::space_type> member_pair, object, array;
+    qi::rule<Iterator, utree(), skipper> start, value;
+    qi::rule<Iterator, utree::list_type(), skipper> member_pair, object, array;
     qi::rule<Iterator, utf8_symbol_type()> member;
-    qi::rule<Iterator, utf8_symbol_type(), ascii::space_type> empty_object, empty_array;
+    qi::rule<Iterator, utf8_symbol_type(), skipper> empty_object, empty_array;
     qi::rule<Iterator, utree::nil_type()> null;
 
     utf8_string_parser<Iterator> utf8;
@@ -0,0 +1,77 @@
+#ifndef MML_READER_H
+#define MML_READER_H
+
+#include <string>
+#include <vector>
+
+#include <boost/spirit/include/support_utree.hpp>
+
+#include <position_iterator.hpp>
+
+namespace carto {
+
+using boost::spirit::utree;
+
+// A member of an MML object. The value is the scalar json_parser would
+// give for it: an unescaped string, a number, a bool or nil. An object or
+// array where a scalar is expected is only marked, by an empty list, and
+// an empty one is the symbol "{}" or "[]" as in the grammar. The location
+// is where json_parser annotates the pair, the first character after the
+// value that is not space or a comment.
+struct mml_member {
+    std::string key;
+    utree value;
+    source_location location;
+};
+
+struct mml_layer {
+    // every member but the Datasource, in order
+    std::vector<mml_member> members;
+
+    bool has_datasource;
+    std::vector<mml_member> datasource;
+    // after the Datasource object, as for a member
+    source_location datasource_location;
+
+    mml_layer() : members(), has_datasource(false), datasource(), datasource_location() { }
+};
+
+// A member of the root object, as the range of entries it gave one of
+// the vectors of an mml_document: one entry of members, or those of a
+// Stylesheet or Layer array.
+struct mml_part {
+    enum part_type { member, stylesheet, layer };
+
+    part_type type;
+    std::size_t begin, end;
+
+    mml_part() : type(member), begin(0), end(0) { }
+};
+
+// What mml_parser builds the map from: the members of the root object,
+// with the entries of all Stylesheet and Layer arrays taken out of them.
+struct mml_document {
+    std::vector<mml_member> members;
+
+    // file names or inline carto source, as Stylesheet entries give them
+    std::vector<std::string> stylesheets;
+
+    std::vector<mml_layer> layers;
+
+    // the root members in document order, which is the order they apply
+    // to the map in
+    std::vector<mml_part> parts;
+};
+
+// Reads MML source straight into an mml_document in one pass, without a
+// parse tree in between. Accepts what json_parser accepts, comments
+// included; strings are found a block at a time and copied out of the
+// source once, and values nothing reads are checked and skipped. Errors
+// are config_error with the location of the character that was not
+// expected, also where Stylesheet, Layer or a Datasource is not an array
+// or object.
+mml_document read_mml(std::string const& in, std::string const& path = "./");
+
+}
+
+#endif
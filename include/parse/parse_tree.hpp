@@ -17,6 +17,7 @@
 
 #include <position_iterator.hpp>
 #include <parse/json_grammar.hpp>
+#include <parse/skipper.hpp>
 
 namespace carto {
 
@@ -85,8 +86,10 @@ private:
     }
 };
 
+// Comments are left out of the tree unless preserve_comments is set
 template<typename parser_type>
-parse_tree build_parse_tree(std::string const& in, std::string const& path = "./")
+parse_tree build_parse_tree(std::string const& in, std::string const& path = "./",
+                            bool preserve_comments = false)
 { 
     parse_tree pt;
     
@@ -97,7 +100,7 @@ parse_tree build_parse_tree(std::string const& in, std::string const& path = "./
     iter it( in.begin()),
          end(in.end());
 
-    bool r = qi::phrase_parse(it, end, p, boost::spirit::ascii::space, pt.ast());
+    bool r = qi::phrase_parse(it, end, p, skipper(preserve_comments), pt.ast());
     if (!r) {
         throw config_error("Parser failed!");
     }
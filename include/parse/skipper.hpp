@@ -0,0 +1,117 @@
+#ifndef SKIPPER_H
+#define SKIPPER_H
+
+#include <string>
+
+#include <boost/spirit/include/qi.hpp>
+
+#include <position_iterator.hpp>
+
+namespace carto {
+
+namespace qi = boost::spirit::qi;
+
+// The end of the run of ascii whitespace from p, and of /* */ and //
+// comments too when comments is set. An unterminated /* is not skipped,
+// so it fails where the grammar expects a token.
+char const* scan_space(char const* p, char const* end, bool comments);
+
+// The first a or b from p, or end, found a block at a time
+char const* find_either(char const* p, char const* end, char a, char b);
+
+// Moves loc over the characters from p to end as position_iterator's
+// increments would, a block at a time; prev is the character before p and
+// becomes the last one.
+void advance_location(source_location& loc, char& prev, char const* p, char const* end);
+
+// The skipper of all grammars, in place of ascii::space. Comments are
+// skipped with the whitespace and never reach the tree, unless the tree is
+// to keep the source as written: with preserve_comments only whitespace is
+// skipped and the grammars parse /* */ comments into carto_comment nodes.
+// Over a string the run is found with scan_space rather than a character
+// at a time.
+struct skipper : qi::primitive_parser<skipper>
+{
+    template <typename Context, typename Iterator>
+    struct attribute {
+        typedef boost::spirit::unused_type type;
+    };
+
+    explicit skipper(bool preserve_comments_ = false)
+      : preserve_comments(preserve_comments_) { }
+
+    template <typename Iterator, typename Context, typename Skipper, typename Attribute>
+    bool parse(Iterator& first, Iterator const& last, Context&, Skipper const&, Attribute&) const
+    {
+        return skip(first, last);
+    }
+
+    template <typename Context>
+    boost::spirit::info what(Context&) const
+    {
+        return boost::spirit::info("skipper");
+    }
+
+    bool preserve_comments;
+
+private:
+    typedef position_iterator<std::string::const_iterator> string_iterator;
+
+    bool skip(string_iterator& first, string_iterator const& last) const
+    {
+        // most calls are between tokens with nothing to skip
+        if (first == last) return false;
+        char c = *first;
+        if (c != ' ' && (c < '\t' || c > '\r') && (c != '/' || preserve_comments))
+            return false;
+
+        char const* p = &*first.base();
+        char const* to = scan_space(p, p + (last.base() - first.base()), !preserve_comments);
+        if (to == p) return false;
+
+        // skippers are tried again after backtracking, over the same run
+        source_location loc = first.location();
+        char prev = first.previous();
+        advance_location(loc, prev, p, to);
+        first.jump(first.base() + (to - p), loc, prev);
+        return true;
+    }
+
+    template <typename Iterator>
+    bool skip(Iterator& first, Iterator const& last) const
+    {
+        // one character at a time, for iterators not over a string
+        Iterator it = first;
+        while (it != last) {
+            char c = *it;
+            if (c == ' ' || (c >= '\t' && c <= '\r')) {
+                ++it;
+                continue;
+            }
+
+            Iterator next = it;
+            if (preserve_comments || c != '/' || ++next == last || (*next != '*' && *next != '/'))
+                break;
+
+            if (*next == '/') {
+                while (it != last && *it != '\n' && *it != '\r') ++it;
+                continue;
+            }
+
+            // from after /* to the first */
+            char prev = 0;
+            for (++next; next != last && !(prev == '*' && *next == '/'); ++next)
+                prev = *next;
+            if (next == last) break;
+            it = ++next;
+        }
+
+        bool moved = it != first;
+        first = it;
+        return moved;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef PARSE_CACHE_H
+#define PARSE_CACHE_H
+
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <parse/parse_tree.hpp>
+#include <parse/mml_reader.hpp>
+
+namespace carto {
+
+// MML documents and carto parse trees of the sources seen before, keyed
+// by path and content, so an unchanged source compiled again is not parsed
+// again. Safe to share between threads. Once capacity of them are held the
+// cache starts over.
+class parse_cache : private boost::noncopyable {
+public:
+    explicit parse_cache(std::size_t capacity = 256);
+
+    mml_document mml(std::string const& in, std::string const& path);
+
+    parse_tree mss(std::string const& in, std::string const& path);
+
+    std::size_t size() const;
+
+    std::size_t hits() const;
+
+    std::size_t misses() const;
+
+    void clear();
+
+private:
+    template <typename Map>
+    bool find(Map const& map, std::string const& key, typename Map::mapped_type& value);
+
+    template <typename Map>
+    void insert(Map& map, std::string const& key, typename Map::mapped_type const& value);
+
+    typedef boost::unordered_map<std::string, mml_document> documents_type;
+    typedef boost::unordered_map<std::string, parse_tree> trees_type;
+
+    mutable boost::mutex mutex_;
+    documents_type documents_;
+    trees_type trees_;
+    std::size_t capacity_;
+    std::size_t hits_;
+    std::size_t misses_;
+};
+
+// The contents of a source file; config_error when it can't be read
+std::string read_source(std::string const& filename);
+
+}
+
+#endif
@@ -87,6 +87,20 @@ public:
         return loc;
     }
 
+    typedef typename boost::detail::iterator_traits<Iterator>::value_type char_type;
+
+    char_type previous() const {
+        return prev;
+    }
+
+    // moves on to a position whose location, and the character before it,
+    // were counted without the iterator
+    void jump(Iterator to, source_location const& to_loc, char_type to_prev) {
+        this->base_reference() = to;
+        loc = to_loc;
+        prev = to_prev;
+    }
+
 private:
     friend class boost::iterator_core_access;
 
@@ -0,0 +1,43 @@
+#ifndef STYLE_INDEX_H
+#define STYLE_INDEX_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace carto {
+
+// Inverted index from interned id/class selector to the styles whose name
+// mentions it. A layer matches every style that mentions all of its
+// selectors, which is the intersection of their posting lists; a layer
+// without any selectors matches every style.
+class style_index {
+public:
+    typedef std::vector<std::size_t> postings_type;
+
+    style_index();
+
+    // split a style name ("#id.class::attachment") into its selectors
+    static std::vector<std::string> selectors(std::string name);
+
+    // returns the index of the new style
+    std::size_t add_style(std::string const& name);
+
+    // indices of the matching styles, in the order they were added
+    postings_type match(std::vector<std::string> const& layer_selectors) const;
+
+    std::string const& style_name(std::size_t i) const;
+
+    std::size_t size() const;
+
+private:
+    typedef std::map<std::string, std::size_t> symbols_type;
+
+    symbols_type symbols_;
+    std::vector<postings_type> postings_;
+    std::vector<std::string> names_;
+};
+
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef STYLE_VARIANT_H
+#define STYLE_VARIANT_H
+
+#include <map>
+#include <string>
+
+#include <boost/spirit/include/support_utree.hpp>
+
+#include <position_iterator.hpp>
+
+namespace carto {
+
+// A named set of @variable values forced over whatever the stylesheets
+// define them as, e.g. the colors of a dark mode. Values are evaluated in
+// the variant file itself, so they can refer to earlier variables of the
+// same file but not to the stylesheets' own.
+struct style_variant {
+    typedef std::map<std::string, boost::spirit::utree> vars_type;
+
+    std::string name;
+    vars_type vars;
+
+    // node types and locations of the values, which come from a different
+    // parse tree than the stylesheets reading them
+    annotations_type annotations;
+
+    style_variant(std::string const& name_ = "") : name(name_), vars(), annotations() { }
+};
+
+// Read a variant from carto source holding only variable definitions.
+// Throws config_error for anything else.
+style_variant parse_variant(std::string const& in, std::string const& name,
+                            bool strict = false, std::string const& path = "./");
+
+// Read a variant file, named after the file without its extension
+style_variant load_variant(std::string filename, bool strict);
+
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <iosfwd>
+
+namespace carto {
+
+// Allocation accounting for carto --alloc-stats. Built with
+// CARTO_ALLOC_STATS (scons alloc_stats=1), global operator new and delete
+// are replaced to count allocations, bytes and live bytes while tracking
+// is on, charged to the current phase; otherwise allocation is left alone
+// and tracking can't be turned on. stat_timer sets the phase, so phases
+// are the --stats ones. The phase is process wide: allocations of worker
+// threads go to whatever phase the main thread is in.
+bool alloc_tracking_available();
+
+// Turns tracking on when it is available. Every allocation reads the
+// flag without a lock, so this has to happen before any other thread is
+// started.
+void enable_alloc_tracking();
+
+bool alloc_tracking_enabled();
+
+// makes phase, a string literal, current and returns the phase that was;
+// 0 is outside any
+char const* set_alloc_phase(char const* phase);
+
+// "### ALLOC: " lines of allocations, bytes and peak live bytes per phase
+void write_alloc_stats(std::ostream& out);
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace carto {
+
+// Phase timings and event counts of one compile, for --stats. Parsers
+// and generators hold a compile_stats pointer that is 0 unless stats are
+// wanted, so with stats off every hook is a single pointer test.
+struct compile_stats {
+    struct timing {
+        double ms;
+        std::size_t calls;
+
+        timing() : ms(0), calls(0) { }
+    };
+
+    typedef std::map<std::string, timing> timings_type;
+    typedef std::map<std::string, std::size_t> counters_type;
+
+    timings_type timings;
+    counters_type counters;
+
+    // phases in the order they first finished
+    std::vector<std::string> order;
+
+    void add_time(std::string const& phase, double ms);
+
+    void count(std::string const& counter, std::size_t n = 1);
+
+    void write_text(std::ostream& out) const;
+
+    void write_json(std::ostream& out) const;
+};
+
+// Adds the time from construction to stop() or destruction to a phase of
+// stats, unless stats is 0. Phases nested in others are counted in both.
+// With allocation tracking on, allocations in between go to the phase.
+// phase must be a string literal.
+class stat_timer {
+public:
+    stat_timer(compile_stats *stats, char const* phase);
+
+    ~stat_timer();
+
+    void stop();
+
+private:
+    compile_stats *stats_;
+    char const* phase_;
+    char const* outer_phase_;
+    boost::posix_time::ptime start_;
+};
+
+inline void count_stat(compile_stats *stats, char const* counter, std::size_t n = 1)
+{
+    if (stats) stats->count(counter, n);
+}
+
+}
+
+#endif
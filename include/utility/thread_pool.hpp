@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <deque>
+
+#include <boost/function.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace carto {
+
+// Fixed size pool of worker threads draining a shared FIFO of tasks. Tasks
+// are expected to handle their own errors; the first exception escaping
+// one is kept, the workers carry on with the other tasks, and wait()
+// rethrows it once they are done. Exceptions of types boost can't copy
+// come back as boost::unknown_exception.
+class thread_pool : private boost::noncopyable {
+public:
+    typedef boost::function<void()> task_type;
+
+    explicit thread_pool(unsigned threads = 0);
+
+    ~thread_pool();
+
+    void submit(task_type const& task);
+
+    // block until every submitted task has finished, then rethrow the
+    // first exception a task let out since the last wait
+    void wait();
+
+    unsigned size() const;
+
+private:
+    void run();
+
+    boost::mutex mutex_;
+    boost::condition_variable work_cond_;
+    boost::condition_variable done_cond_;
+    std::deque<task_type> tasks_;
+    unsigned active_;
+    boost::exception_ptr error_;
+    unsigned size_;
+    bool stopping_;
+    boost::thread_group threads_;
+};
+
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace carto {
+
+// Begin and end events of compile steps with the thread each ran on,
+// written as Chrome trace_event JSON for chrome://tracing or Perfetto.
+// As with compile_stats, parsers hold a pointer that is 0 unless tracing.
+// Events may be recorded from any thread.
+class compile_trace : private boost::noncopyable {
+public:
+    compile_trace();
+
+    void begin(char const* category, std::string const& name);
+
+    void end(char const* category, std::string const& name);
+
+    std::size_t size() const;
+
+    void write_json(std::ostream& out) const;
+
+private:
+    struct event {
+        char phase;
+        char const* category;
+        std::string name;
+        boost::int64_t timestamp;
+        unsigned thread;
+    };
+
+    void record(char phase, char const* category, std::string const& name);
+
+    mutable boost::mutex mutex_;
+    boost::posix_time::ptime start_;
+    std::vector<event> events_;
+
+    // small numbers for thread ids, in the order threads first record
+    std::map<boost::thread::id, unsigned> threads_;
+};
+
+// Records a begin event in trace on construction and the matching end
+// event on stop() or destruction, unless trace is 0.
+class trace_scope : private boost::noncopyable {
+public:
+    trace_scope(compile_trace *trace, char const* category, std::string const& name);
+
+    ~trace_scope();
+
+    void stop();
+
+private:
+    compile_trace *trace_;
+    char const* category_;
+    std::string name_;
+};
+
+}
+
+#endif
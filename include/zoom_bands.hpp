@@ -0,0 +1,33 @@
+#ifndef ZOOM_BANDS_H
+#define ZOOM_BANDS_H
+
+#include <string>
+#include <vector>
+
+#include <mapnik/map.hpp>
+
+namespace carto {
+
+// A range of zoom levels, both ends included.
+struct zoom_band {
+    unsigned min_zoom, max_zoom;
+
+    zoom_band(unsigned min = 0, unsigned max = 0) : min_zoom(min), max_zoom(max) { }
+
+    // "5" or "0-5", as used in output file names
+    std::string get_string() const;
+};
+
+// Parse "0-5,6,7-22" into bands; an empty spec gives one band per zoom
+// level. Throws config_error for malformed or out of range bands.
+std::vector<zoom_band> parse_zoom_bands(std::string const& spec);
+
+// A copy of map with only what can render within band: rules whose scale
+// range misses it are dropped, as are styles left without rules and
+// layers left without styles or outside their own zoom range. Rules
+// covering the whole band lose their scale range.
+mapnik::Map specialize_map(mapnik::Map const& map, zoom_band const& band);
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include <batch_compiler.hpp>
+
+#include <fstream>
+#include <sstream>
+
+#include <mapnik/config_error.hpp>
+#include <mapnik/save_map.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <parse_cache.hpp>
+#include <utility/thread_pool.hpp>
+
+namespace carto {
+
+using mapnik::config_error;
+
+std::vector<batch_job> read_manifest(std::string const& filename)
+{
+    namespace fs = boost::filesystem;
+
+    std::ifstream in(filename.c_str());
+    if (!in.is_open())
+        throw config_error("Could not open manifest " + filename);
+
+    fs::path base = fs::path(filename).parent_path();
+    std::vector<batch_job> jobs;
+    std::string line;
+
+    for (std::size_t number = 1; std::getline(in, line); ++number) {
+        boost::algorithm::trim(line);
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream words(line);
+        std::string input, output, rest;
+        words >> input >> output >> rest;
+
+        if (output.empty() || !rest.empty())
+            throw config_error("Expected an input and an output file at " + filename + ":" +
+                               boost::lexical_cast<std::string>(number));
+
+        if (!boost::algorithm::ends_with(input, ".mml") && !boost::algorithm::ends_with(input, ".mss"))
+            throw config_error("Input is not an mml or mss file at " + filename + ":" +
+                               boost::lexical_cast<std::string>(number));
+
+        fs::path input_path(input), output_path(output);
+        if (input_path.is_relative()) input_path = base / input_path;
+        if (output_path.is_relative()) output_path = base / output_path;
+
+        jobs.push_back(batch_job(input_path.string(), output_path.string()));
+    }
+
+    return jobs;
+}
+
+static void compile_job(batch_job& job, compile_options const& options)
+{
+    using namespace boost::posix_time;
+    ptime start = microsec_clock::universal_time();
+
+    try {
+        std::string in = read_source(job.input);
+        compile_result result = boost::algorithm::ends_with(job.input, ".mml")
+                              ? compile_mml(in, job.input, options)
+                              : compile_mss(in, job.input, options);
+
+        std::ofstream file(job.output.c_str());
+        if (!file.is_open())
+            throw config_error("could not save xml to: " + job.output);
+        file << mapnik::save_map_to_string(result.map, false);
+        file.close();
+        if (!file)
+            throw config_error("could not write xml to: " + job.output);
+
+        job.warnings.swap(result.warnings);
+    } catch (std::exception& e) {
+        job.error = e.what();
+    } catch (...) {
+        job.error = "Unknown error";
+    }
+
+    job.ms = (microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+}
+
+std::size_t compile_batch(std::vector<batch_job>& jobs, compile_options const& options,
+                          unsigned threads)
+{
+    {
+        thread_pool pool(threads);
+
+        // every task writes only to its own job
+        for (std::size_t i = 0; i < jobs.size(); ++i)
+            pool.submit(boost::bind(&compile_job, boost::ref(jobs[i]), boost::cref(options)));
+        pool.wait();
+    }
+
+    std::size_t failed = 0;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        if (!jobs[i].error.empty())
+            ++failed;
+    }
+    return failed;
+}
+
+}
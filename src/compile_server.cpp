@@ -0,0 +1,247 @@
+#include <compile_server.hpp>
+
+#include <csignal>
+#include <sstream>
+
+#include <mapnik/config_error.hpp>
+#include <mapnik/save_map.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+#include <parse_cache.hpp>
+
+namespace carto {
+
+using mapnik::config_error;
+
+compile_server::compile_server(std::string const& socket_path, compile_options const& options,
+                               unsigned jobs, std::size_t max_source, unsigned read_timeout)
+  : socket_path_(socket_path),
+    options_(options),
+    max_source_(max_source),
+    read_timeout_(read_timeout),
+    io_(),
+    acceptor_(io_),
+    signals_(io_, SIGINT, SIGTERM),
+    pool_(jobs),
+    requests_(0)
+{
+    // a socket left behind by a server that didn't shut down cleanly
+    boost::filesystem::remove(socket_path_);
+
+    protocol::endpoint endpoint(socket_path_);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+}
+
+compile_server::~compile_server()
+{
+    boost::system::error_code ignored;
+    boost::filesystem::remove(socket_path_, ignored);
+}
+
+void compile_server::run()
+{
+    signals_.async_wait(boost::bind(&compile_server::stop, this));
+    accept();
+    io_.run();
+    pool_.wait();
+}
+
+std::size_t compile_server::requests() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return requests_;
+}
+
+void compile_server::stop()
+{
+    boost::system::error_code ignored;
+    acceptor_.close(ignored);
+    io_.stop();
+}
+
+void compile_server::accept()
+{
+    connection_ptr conn(new connection(io_));
+    acceptor_.async_accept(conn->socket,
+                           boost::bind(&compile_server::handle_accept, this, conn,
+                                       boost::asio::placeholders::error));
+}
+
+void compile_server::handle_accept(connection_ptr conn, boost::system::error_code const& error)
+{
+    if (error) return;
+
+    read_request(conn);
+    accept();
+}
+
+void compile_server::read_request(connection_ptr conn)
+{
+    boost::asio::async_read_until(conn->socket, conn->buffer, '\n',
+                                  boost::bind(&compile_server::handle_request, this, conn,
+                                              boost::asio::placeholders::error));
+}
+
+// the length of mml-source and mss-source requests, 0 for the others
+// and for requests respond() rejects
+static std::size_t source_length(std::string const& request)
+{
+    std::istringstream words(request);
+    std::string command;
+    std::size_t length = 0;
+
+    words >> command;
+    if ((command == "mml-source" || command == "mss-source") && !(words >> length))
+        length = 0;
+    return length;
+}
+
+void compile_server::handle_request(connection_ptr conn, boost::system::error_code const& error)
+{
+    // the client hung up
+    if (error) return;
+
+    std::istream in(&conn->buffer);
+    std::getline(in, conn->request);
+
+    std::size_t length = source_length(conn->request);
+
+    if (length > max_source_) {
+        std::ostringstream message;
+        message << "Source of " << length << " bytes is over the limit of " << max_source_;
+
+        // the source isn't read, so nothing after it can be either
+        write_answer(conn, error_answer(message.str()), false);
+        return;
+    }
+
+    if (conn->buffer.size() >= length) {
+        pool_.submit(boost::bind(&compile_server::serve, this, conn, length));
+        return;
+    }
+
+    // the source is read here, without holding a pool thread, and a
+    // client that stops sending it is dropped
+    conn->timer.expires_from_now(boost::posix_time::seconds(read_timeout_));
+    conn->timer.async_wait(boost::bind(&compile_server::handle_timeout, this, conn));
+
+    boost::asio::async_read(conn->socket, conn->buffer,
+                            boost::asio::transfer_at_least(length - conn->buffer.size()),
+                            boost::bind(&compile_server::handle_source, this, conn, length,
+                                        boost::asio::placeholders::error));
+}
+
+void compile_server::handle_source(connection_ptr conn, std::size_t length,
+                                   boost::system::error_code const& error)
+{
+    conn->timer.expires_at(boost::posix_time::pos_infin);
+
+    // the client hung up or timed out
+    if (error) return;
+
+    pool_.submit(boost::bind(&compile_server::serve, this, conn, length));
+}
+
+void compile_server::handle_timeout(connection_ptr conn)
+{
+    // the source arrived, or the timer was set again since
+    if (conn->timer.expires_at() > boost::asio::deadline_timer::traits_type::now())
+        return;
+
+    boost::system::error_code ignored;
+    conn->socket.close(ignored);
+}
+
+void compile_server::serve(connection_ptr conn, std::size_t length)
+{
+    std::string body;
+    if (length) {
+        std::istream in(&conn->buffer);
+        body.resize(length);
+        in.read(&body[0], length);
+    }
+
+    io_.post(boost::bind(&compile_server::write_answer, this, conn,
+                         respond(conn->request, body), true));
+}
+
+void compile_server::write_answer(connection_ptr conn, std::string const& answer, bool keep_open)
+{
+    conn->answer = answer;
+    boost::asio::async_write(conn->socket, boost::asio::buffer(conn->answer),
+                             boost::bind(&compile_server::handle_write, this, conn, keep_open,
+                                         boost::asio::placeholders::error));
+}
+
+void compile_server::handle_write(connection_ptr conn, bool keep_open,
+                                  boost::system::error_code const& error)
+{
+    if (error || !keep_open) return;
+
+    read_request(conn);
+}
+
+static void write_result(std::ostream& out, compile_result const& result)
+{
+    std::string xml = mapnik::save_map_to_string(result.map, false);
+
+    out << "ok " << xml.size() << " " << result.warnings.size() << "\n";
+    for (std::size_t i = 0; i < result.warnings.size(); ++i)
+        out << result.warnings[i] << "\n";
+    out << xml;
+}
+
+std::string compile_server::respond(std::string const& request, std::string const& body)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        ++requests_;
+    }
+
+    std::ostringstream answer;
+
+    try {
+        std::istringstream words(request);
+        std::string command, path;
+        words >> command;
+
+        bool inline_source = command == "mml-source" || command == "mss-source";
+        std::size_t length = 0;
+        if (inline_source && !(words >> length))
+            throw config_error("Missing source length in request: " + request);
+
+        std::getline(words >> std::ws, path);
+        if (path.empty())
+            throw config_error("Missing path in request: " + request);
+
+        if (command != "mml" && command != "mss" && !inline_source)
+            throw config_error("Unknown request: " + request);
+
+        std::string in = inline_source ? body : read_source(path);
+
+        if (command == "mml" || command == "mml-source")
+            write_result(answer, compile_mml(in, path, options_));
+        else
+            write_result(answer, compile_mss(in, path, options_));
+    } catch (std::exception& e) {
+        return error_answer(e.what());
+    } catch (...) {
+        // a task letting this out would drop the connection unanswered
+        return error_answer("Unknown error");
+    }
+
+    return answer.str();
+}
+
+std::string compile_server::error_answer(std::string const& message)
+{
+    std::ostringstream answer;
+    answer << "error " << message.size() << "\n" << message;
+    return answer.str();
+}
+
+}
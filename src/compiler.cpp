@@ -0,0 +1,193 @@
+#include <compiler.hpp>
+
+#include <sstream>
+
+#include <mapnik/config_error.hpp>
+
+#include <boost/algorithm/string.hpp>
+
+#include <mml_parser.hpp>
+#include <mss_parser.hpp>
+#include <feature_sampler.hpp>
+#include <exception.hpp>
+#include <intermediate/mss_parser.hpp>
+#include <intermediate/mss_to_mapnik.hpp>
+#include <utility/environment.hpp>
+
+namespace carto {
+
+compile_options::compile_options()
+  : strict(false),
+    lazy_datasources(false),
+    infer_zooms(false),
+    project_columns(false),
+    prune_rules(false),
+    merge_zooms(false),
+    fold_values(false),
+    share_styles(false),
+    order_filters(false),
+    sample_limit(0),
+    profile_limit(0),
+    variant(0),
+    sources(),
+    datasources(),
+    cache(),
+    width(800),
+    height(600) { }
+
+static void collect_warnings(std::string const& log, std::vector<std::string>& warnings)
+{
+    std::string const prefix = "### WARNING: ";
+
+    std::istringstream in(log);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (boost::algorithm::starts_with(line, prefix))
+            warnings.push_back(line.substr(prefix.size()));
+        else if (!line.empty())
+            warnings.push_back(line);
+    }
+}
+
+static mml_parser configured_parser(std::string const& in, std::string const& path,
+                                    compile_options const& options, std::ostream& log)
+{
+    mml_parser parser = options.cache ? mml_parser(options.cache->mml(in, path), options.strict, path)
+                                      : load_mml_string(in, options.strict, path);
+    parser.lazy_datasources = options.lazy_datasources;
+    parser.infer_zooms = options.infer_zooms;
+    parser.project_columns = options.project_columns;
+    parser.prune_rules = options.prune_rules;
+    parser.merge_zooms = options.merge_zooms;
+    parser.fold_values = options.fold_values;
+    parser.share_styles = options.share_styles;
+    if (options.order_filters || options.sample_limit)
+        parser.filter_order = intermediate::order_by_cost;
+    if (options.datasources)
+        parser.datasources = options.datasources;
+    parser.variant = options.variant;
+    parser.sources = &options.sources;
+    parser.cache = options.cache.get();
+    parser.log = &log;
+    return parser;
+}
+
+// compiles once to learn which conditions and rules each style has, then
+// looks at the data, as carto does for --sample-filters and --profile-data
+static void sample_data(std::string const& in, std::string const& path,
+                        compile_options const& options, std::ostream& log,
+                        intermediate::selectivity_type& selectivity,
+                        intermediate::rule_hits_type& rule_hits)
+{
+    // the real compile warns about the same things, only the sampling's
+    // own warnings go to log
+    std::ostringstream scratch;
+    mapnik::Map sample_map(options.width, options.height);
+    intermediate::conditions_type conditions;
+    intermediate::rule_names_type rule_names;
+
+    mml_parser sampler = configured_parser(in, path, options, scratch);
+    sampler.lazy_datasources = false;
+    sampler.conditions = &conditions;
+    sampler.rule_names = &rule_names;
+    sampler.parse_map(sample_map);
+
+    if (options.sample_limit)
+        selectivity = sample_selectivity(sample_map, conditions, options.sample_limit, &log);
+
+    if (options.profile_limit) {
+        std::vector<feature_sample> samples = sample_layers(sample_map, options.profile_limit, &log);
+        rule_hits = count_rule_matches(sample_map, rule_names, samples);
+    }
+}
+
+static compile_result build_mml(std::string const& in, std::string const& path,
+                                compile_options const& options)
+{
+    std::ostringstream log;
+    compile_result result(options.width, options.height);
+
+    intermediate::selectivity_type selectivity;
+    intermediate::rule_hits_type rule_hits;
+    if (options.sample_limit || options.profile_limit)
+        sample_data(in, path, options, log, selectivity, rule_hits);
+
+    mml_parser parser = configured_parser(in, path, options, log);
+    if (options.sample_limit)
+        parser.selectivity = &selectivity;
+    if (options.profile_limit)
+        parser.rule_hits = &rule_hits;
+
+    parser.parse_map(result.map);
+
+    collect_warnings(log.str(), result.warnings);
+    return result;
+}
+
+static compile_result build_mss(std::string const& in, std::string const& path,
+                                compile_options const& options)
+{
+    std::ostringstream log;
+    compile_result result(options.width, options.height);
+
+    mss_parser parser = options.cache ? mss_parser(options.cache->mss(in, path), options.strict, path)
+                                      : mss_parser(in, options.strict, path);
+    parser.prune_rules = options.prune_rules;
+    parser.merge_zooms = options.merge_zooms;
+    parser.fold_values = options.fold_values;
+    if (options.order_filters)
+        parser.filter_order = intermediate::order_by_cost;
+    parser.variant = options.variant;
+    parser.log = &log;
+
+    style_env env;
+    parser.parse_stylesheet(result.map, env);
+
+    collect_warnings(log.str(), result.warnings);
+    return result;
+}
+
+// What build_mml or build_mss let out, as the config_error to throw
+// instead: syntax errors of the carto grammar are carto::exception, those
+// found building the intermediate form parser_error, and the generator's
+// generation_error.
+static mapnik::config_error current_config_error()
+{
+    try {
+        throw;
+    } catch (mapnik::config_error& e) {
+        return e;
+    } catch (carto::exception& e) {
+        return mapnik::config_error(e.what());
+    } catch (intermediate::parser_error& e) {
+        return mapnik::config_error(e.what());
+    } catch (intermediate::generation_error& e) {
+        return mapnik::config_error(e.what());
+    } catch (std::exception& e) {
+        return mapnik::config_error(e.what());
+    } catch (...) {
+        return mapnik::config_error("Unknown error");
+    }
+}
+
+compile_result compile_mml(std::string const& in, std::string const& path,
+                           compile_options const& options)
+{
+    try {
+        return build_mml(in, path, options);
+    } catch (...) {
+        throw current_config_error();
+    }
+}
+
+compile_result compile_mss(std::string const& in, std::string const& path,
+                           compile_options const& options)
+{
+    try {
+        return build_mss(in, path, options);
+    } catch (...) {
+        throw current_config_error();
+    }
+}
+
+}
@@ -0,0 +1,73 @@
+#include <datasource_pool.hpp>
+
+#include <sstream>
+
+#include <mapnik/datasource_cache.hpp>
+
+#include <deferred_datasource.hpp>
+
+namespace carto {
+
+datasource_pool::datasource_pool()
+  : pool_(),
+    shared_(0) { }
+
+std::string datasource_pool::key(mapnik::parameters const& params)
+{
+    std::stringstream oss;
+
+    // parameters is an ordered map, so equal sets produce equal keys;
+    // length prefixes keep values containing separators unambiguous
+    for (mapnik::parameters::const_iterator it = params.begin();
+         it != params.end();
+         ++it) {
+        std::string value = *params.get<std::string>(it->first);
+        oss << it->first.size() << ':' << it->first
+            << value.size() << ':' << value;
+    }
+
+    return oss.str();
+}
+
+mapnik::datasource_ptr datasource_pool::get(mapnik::parameters const& params, bool lazy)
+{
+    std::string k = key(params);
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    pool_type::const_iterator it = pool_.find(k);
+    if (it != pool_.end()) {
+        ++shared_;
+        return it->second;
+    }
+
+    mapnik::datasource_ptr ds;
+    if (lazy)
+        ds.reset(new deferred_datasource(params));
+    else
+        ds = mapnik::datasource_cache::instance()->create(params, false);
+
+    pool_[k] = ds;
+    return ds;
+}
+
+std::size_t datasource_pool::size() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return pool_.size();
+}
+
+std::size_t datasource_pool::shared() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return shared_;
+}
+
+void datasource_pool::clear()
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    pool_.clear();
+    shared_ = 0;
+}
+
+}
@@ -0,0 +1,130 @@
+#include <deferred_datasource.hpp>
+
+#include <map>
+#include <sstream>
+#include <algorithm>
+
+#include <mapnik/layer.hpp>
+#include <mapnik/datasource_cache.hpp>
+
+#include <boost/bind.hpp>
+
+#include <utility/thread_pool.hpp>
+
+namespace carto {
+
+deferred_datasource::deferred_datasource(mapnik::parameters const& params)
+  : mapnik::datasource(params) { }
+
+deferred_datasource::~deferred_datasource() { }
+
+mapnik::datasource_ptr deferred_datasource::get() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (!ds_) {
+        ds_ = mapnik::datasource_cache::instance()->create(params_, false);
+        ds_->bind();
+        is_bound_ = true;
+    }
+
+    return ds_;
+}
+
+bool deferred_datasource::created() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return ds_.get() != 0;
+}
+
+void deferred_datasource::bind() const
+{
+    get();
+}
+
+int deferred_datasource::type() const
+{
+    return get()->type();
+}
+
+mapnik::featureset_ptr deferred_datasource::features(mapnik::query const& q) const
+{
+    return get()->features(q);
+}
+
+mapnik::featureset_ptr deferred_datasource::features_at_point(mapnik::coord2d const& pt) const
+{
+    return get()->features_at_point(pt);
+}
+
+mapnik::box2d<double> deferred_datasource::envelope() const
+{
+    return get()->envelope();
+}
+
+mapnik::layer_descriptor deferred_datasource::get_descriptor() const
+{
+    return get()->get_descriptor();
+}
+
+static void validate_datasource(mapnik::datasource_ptr const& ds, std::string& error)
+{
+    try {
+        // deferred_datasource::bind creates the real datasource, plugin
+        // datasources open their files/connections
+        ds->bind();
+    } catch (std::exception& e) {
+        error = e.what();
+    }
+}
+
+std::vector<std::string> validate_datasources(mapnik::Map const& map, unsigned jobs)
+{
+    std::vector<mapnik::layer> const& layers = map.layers();
+
+    // layers of a pool share datasources, and a plugin's bind() is not
+    // safe to run twice at once, so every distinct instance is bound by
+    // one task only and its outcome is reported for each layer using it
+    std::vector<mapnik::datasource_ptr> distinct;
+    std::vector<std::size_t> index(layers.size());
+    std::map<mapnik::datasource const*, std::size_t> seen;
+
+    for (std::size_t i = 0; i < layers.size(); ++i) {
+        mapnik::datasource_ptr ds = layers[i].datasource();
+        if (!ds) continue;
+
+        std::pair<std::map<mapnik::datasource const*, std::size_t>::iterator, bool> r
+            = seen.insert(std::make_pair(ds.get(), distinct.size()));
+        if (r.second)
+            distinct.push_back(ds);
+        index[i] = r.first->second;
+    }
+
+    std::vector<std::string> failures(distinct.size());
+
+    if (jobs > 1 && distinct.size() > 1) {
+        thread_pool pool(std::min<std::size_t>(jobs, distinct.size()));
+
+        // every task writes only to its own slot in failures
+        for (std::size_t i = 0; i < distinct.size(); ++i)
+            pool.submit(boost::bind(&validate_datasource, boost::cref(distinct[i]),
+                                    boost::ref(failures[i])));
+        pool.wait();
+    } else {
+        for (std::size_t i = 0; i < distinct.size(); ++i)
+            validate_datasource(distinct[i], failures[i]);
+    }
+
+    std::vector<std::string> errors;
+    for (std::size_t i = 0; i < layers.size(); ++i) {
+        if (!layers[i].datasource() || failures[index[i]].empty()) continue;
+
+        std::stringstream err;
+        err << "Datasource creation issue (" << failures[index[i]]
+            << ") in layer " << layers[i].name();
+        errors.push_back(err.str());
+    }
+    return errors;
+}
+
+}
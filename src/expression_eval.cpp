@@ -11,10 +11,12 @@ namespace carto {
 using mapnik::config_error;
 using boost::spirit::utree_type;
 
-expression::expression(utree const& tree_, annotations_type const& annotations_, style_env const& env_)
+expression::expression(utree const& tree_, annotations_type const& annotations_, style_env const& env_,
+                       compile_stats *stats_)
   : tree(tree_),
     annotations(annotations_),
-    env(env_) { }
+    env(env_),
+    stats(stats_) { }
 
 int expression::get_node_type(utree const& ut)
 {   
@@ -33,7 +35,7 @@ utree expression::eval()
 
 utree expression::eval_var(utree const& node) {
     std::string key = as<std::string>(node);
-    std::clog << key << std::endl;
+    count_stat(stats, "variable lookups");
     utree value = env.vars.lookup(key);
     
     if (value == utree::nil_type()) {
@@ -86,8 +88,6 @@ utree expression::eval_node(utree const& node)
     } else {
         if(get_node_type(node) == exp_var)
             return eval_var(node);
-
-        std::cout << "Shouldn't be here!\n";
     }
     
     return utree();
@@ -0,0 +1,194 @@
+#include <feature_sampler.hpp>
+
+#include <map>
+#include <cmath>
+#include <ostream>
+
+#include <mapnik/query.hpp>
+#include <mapnik/datasource.hpp>
+#include <mapnik/expression_evaluator.hpp>
+#include <mapnik/filter_factory.hpp>
+
+namespace carto {
+
+feature_sample sample_features(mapnik::layer const& lyr, std::size_t limit,
+                               std::ostream* log)
+{
+    feature_sample sample;
+
+    mapnik::datasource_ptr ds = lyr.datasource();
+    if (!ds) return sample;
+
+    try {
+        mapnik::query q(ds->envelope(), mapnik::query::resolution_type(1.0, 1.0), 1.0);
+
+        std::vector<mapnik::attribute_descriptor> const& desc = ds->get_descriptor().get_descriptors();
+        for (std::vector<mapnik::attribute_descriptor>::const_iterator it = desc.begin();
+             it != desc.end();
+             ++it) {
+            q.add_property_name(it->get_name());
+        }
+
+        mapnik::featureset_ptr fs = ds->features(q);
+        if (!fs) return sample;
+
+        for (mapnik::feature_ptr f = fs->next(); f && sample.size() < limit; f = fs->next())
+            sample.push_back(f);
+    } catch (std::exception& e) {
+        if (log)
+            *log << "### WARNING: could not sample layer " << lyr.name()
+                 << ": " << e.what() << "\n";
+        sample.clear();
+    }
+
+    return sample;
+}
+
+bool feature_matches(mapnik::expression_ptr const& expr, mapnik::Feature const& feature)
+{
+    mapnik::value_type result = boost::apply_visitor(
+        mapnik::evaluate<mapnik::Feature, mapnik::value_type>(feature), *expr);
+    return result.to_bool();
+}
+
+std::vector<feature_sample> sample_layers(mapnik::Map const& map, std::size_t limit,
+                                          std::ostream* log)
+{
+    std::vector<feature_sample> samples;
+    for (std::size_t i = 0; i < map.layer_count(); ++i)
+        samples.push_back(sample_features(map.getLayer(i), limit, log));
+    return samples;
+}
+
+intermediate::selectivity_type
+sample_selectivity(mapnik::Map const& map,
+                   intermediate::conditions_type const& conditions,
+                   std::size_t limit,
+                   std::ostream* log)
+{
+    typedef std::map<std::string, std::pair<std::size_t, std::size_t> > counts_type;
+    typedef std::map<std::string, mapnik::expression_ptr> exprs_type;
+
+    counts_type counts;     // passed, seen
+    exprs_type exprs;
+
+    for (std::size_t i = 0; i < map.layer_count(); ++i) {
+        mapnik::layer const& lyr = map.getLayer(i);
+        std::vector<std::string> const& styles = lyr.styles();
+
+        feature_sample sample;
+        bool sampled = false;
+
+        for (std::vector<std::string>::const_iterator st_it = styles.begin();
+             st_it != styles.end();
+             ++st_it) {
+            intermediate::conditions_type::const_iterator c_it = conditions.find(*st_it);
+            if (c_it == conditions.end()) continue;
+
+            if (!sampled) {
+                sample = sample_features(lyr, limit, log);
+                sampled = true;
+            }
+
+            for (std::set<std::string>::const_iterator it = c_it->second.begin();
+                 it != c_it->second.end();
+                 ++it) {
+                exprs_type::iterator e_it = exprs.find(*it);
+                if (e_it == exprs.end())
+                    e_it = exprs.insert(std::make_pair(*it, mapnik::parse_expression(*it, "utf8"))).first;
+
+                std::pair<std::size_t, std::size_t> &count = counts[*it];
+                for (feature_sample::const_iterator f_it = sample.begin(); f_it != sample.end(); ++f_it) {
+                    if (feature_matches(e_it->second, **f_it)) ++count.first;
+                    ++count.second;
+                }
+            }
+        }
+    }
+
+    intermediate::selectivity_type selectivity;
+    for (counts_type::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+        if (it->second.second)
+            selectivity[it->first] = double(it->second.first) / it->second.second;
+    }
+
+    return selectivity;
+}
+
+intermediate::rule_hits_type
+count_rule_matches(mapnik::Map const& map,
+                   intermediate::rule_names_type const& names,
+                   std::vector<feature_sample> const& samples)
+{
+    intermediate::rule_hits_type hits;
+
+    for (std::size_t i = 0; i < map.layer_count() && i < samples.size(); ++i) {
+        std::vector<std::string> const& styles = map.getLayer(i).styles();
+
+        for (std::vector<std::string>::const_iterator st_it = styles.begin();
+             st_it != styles.end();
+             ++st_it) {
+            boost::optional<mapnik::feature_type_style const&> style = map.find_style(*st_it);
+            intermediate::rule_names_type::const_iterator n_it = names.find(*st_it);
+            if (!style || n_it == names.end()) continue;
+
+            mapnik::feature_type_style::rules const& rules = style->get_rules();
+            for (std::size_t r = 0; r < rules.size() && r < n_it->second.size(); ++r) {
+                unsigned active = 0;
+                for (unsigned z = 0; z < intermediate::zoom_levels; ++z) {
+                    std::pair<double, double> range = intermediate::zoom_scale_range(z);
+                    if (rules[r].active(std::sqrt(range.first * range.second)))
+                        ++active;
+                }
+                if (!active) continue;
+
+                std::size_t &count = hits[*st_it][n_it->second[r]];
+                for (feature_sample::const_iterator f_it = samples[i].begin(); f_it != samples[i].end(); ++f_it) {
+                    if (feature_matches(rules[r].get_filter(), **f_it))
+                        count += active;
+                }
+            }
+        }
+    }
+
+    return hits;
+}
+
+double filter_evaluations(mapnik::Map const& map,
+                          std::vector<feature_sample> const& samples)
+{
+    std::size_t evaluations = 0,
+                features = 0;
+
+    for (std::size_t i = 0; i < map.layer_count() && i < samples.size(); ++i) {
+        std::vector<std::string> const& styles = map.getLayer(i).styles();
+        features += samples[i].size() * intermediate::zoom_levels;
+
+        for (unsigned z = 0; z < intermediate::zoom_levels; ++z) {
+            std::pair<double, double> range = intermediate::zoom_scale_range(z);
+            double scale = std::sqrt(range.first * range.second);
+
+            for (std::vector<std::string>::const_iterator st_it = styles.begin();
+                 st_it != styles.end();
+                 ++st_it) {
+                boost::optional<mapnik::feature_type_style const&> style = map.find_style(*st_it);
+                if (!style) continue;
+
+                mapnik::feature_type_style::rules const& rules = style->get_rules();
+                for (feature_sample::const_iterator f_it = samples[i].begin(); f_it != samples[i].end(); ++f_it) {
+                    for (std::size_t r = 0; r < rules.size(); ++r) {
+                        if (!rules[r].active(scale)) continue;
+
+                        ++evaluations;
+                        if (feature_matches(rules[r].get_filter(), **f_it))
+                            break;
+                    }
+                }
+            }
+        }
+    }
+
+    return features ? double(evaluations) / features : 0;
+}
+
+}
@@ -0,0 +1,68 @@
+#include <intermediate/attribute_collector.hpp>
+
+#include <utility/utree.hpp>
+
+namespace carto { namespace intermediate {
+
+using carto::detail::as;
+
+attribute_collector::attribute_collector(styles_type &styles) : styles(styles) { }
+
+bool attribute_collector::is_expression_key(std::string const& key) {
+    if (key == "text-name" || key == "shield-name" || key == "building-height")
+        return true;
+
+    // point-file, marker-file, shield-file, ... are path expressions
+    return key.size() > 5 && key.compare(key.size() - 5, 5, "-file") == 0;
+}
+
+void attribute_collector::collect_fields(std::string const& expr, attribute_set &attrs) {
+    char quote = 0;
+
+    for (std::string::size_type i = 0; i < expr.size(); ++i) {
+        char c = expr[i];
+
+        if (quote) {
+            if (c == quote) quote = 0;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '[') {
+            std::string::size_type end = expr.find(']', i + 1);
+            if (end == std::string::npos) return;
+
+            attrs.insert(expr.substr(i + 1, end - i - 1));
+            i = end;
+        }
+    }
+}
+
+void attribute_collector::visit(stylesheet const& styl) {
+    for(stylesheet::rules_type::const_iterator it = styl.rules.begin();
+        it != styl.rules.end();
+        ++it) {
+        visit(*it);
+    }
+}
+
+void attribute_collector::visit(rule const& rule) {
+    // rules without attributes are never emitted
+    if (rule.attrs.empty()) return;
+
+    attribute_set &attrs = styles[rule.get_partial_name()];
+
+    for(rule::filters_type::const_iterator it = rule.filters.begin();
+        it != rule.filters.end();
+        ++it) {
+        if (it->key != "zoom")
+            attrs.insert(it->key);
+    }
+
+    for(rule::attributes_type::const_iterator it = rule.attrs.begin();
+        it != rule.attrs.end();
+        ++it) {
+        if (is_expression_key(it->first))
+            collect_fields(as<std::string>(it->second), attrs);
+    }
+}
+
+} }
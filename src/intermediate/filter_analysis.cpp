@@ -0,0 +1,237 @@
+#include <intermediate/filter_analysis.hpp>
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <utility/utree.hpp>
+
+namespace carto { namespace intermediate {
+
+using carto::detail::as;
+using boost::spirit::utree_type;
+
+typedef key_constraint::bound bound;
+typedef std::pair<bound, bound> interval_type;
+
+static bool is_number(utree const& value) {
+    return value.which() == utree_type::double_type ||
+           value.which() == utree_type::int_type;
+}
+
+static bool is_empty(interval_type const& i) {
+    return i.first.value > i.second.value ||
+           (i.first.value == i.second.value && !(i.first.closed && i.second.closed));
+}
+
+static bool contains(interval_type const& i, double v) {
+    return (v > i.first.value || (v == i.first.value && i.first.closed)) &&
+           (v < i.second.value || (v == i.second.value && i.second.closed));
+}
+
+static bool contains(interval_type const& outer, interval_type const& inner) {
+    bool lower = outer.first.value < inner.first.value ||
+                 (outer.first.value == inner.first.value && (outer.first.closed || !inner.first.closed));
+    bool upper = outer.second.value > inner.second.value ||
+                 (outer.second.value == inner.second.value && (outer.second.closed || !inner.second.closed));
+    return lower && upper;
+}
+
+key_constraint::key_constraint()
+  : lower(-std::numeric_limits<double>::infinity(), true),
+    upper(std::numeric_limits<double>::infinity(), true),
+    has_eq(false),
+    eq(),
+    neq(),
+    conflict(false),
+    opaque(false),
+    integral(false),
+    filters() { }
+
+bool key_constraint::is_integral_key(std::string const& key) {
+    return key == "zoom";
+}
+
+void key_constraint::add(filter_selector const& filter) {
+    filters.push_back(filter);
+
+    bool numeric = is_number(filter.value);
+    double v = numeric ? as<double>(filter.value) : 0;
+
+    switch(filter.pred) {
+        case filter_selector::pred_eq:
+            if (has_eq && !(eq == filter.value))
+                conflict = true;
+            has_eq = true;
+            eq = filter.value;
+            break;
+
+        case filter_selector::pred_neq:
+            neq.push_back(filter.value);
+            break;
+
+        case filter_selector::pred_gt:
+        case filter_selector::pred_ge:
+        {
+            if (!numeric) { opaque = true; break; }
+            bool closed = filter.pred == filter_selector::pred_ge;
+            if (v > lower.value || (v == lower.value && !closed))
+                lower = bound(v, closed);
+            break;
+        }
+
+        case filter_selector::pred_lt:
+        case filter_selector::pred_le:
+        {
+            if (!numeric) { opaque = true; break; }
+            bool closed = filter.pred == filter_selector::pred_le;
+            if (v < upper.value || (v == upper.value && !closed))
+                upper = bound(v, closed);
+            break;
+        }
+
+        default:
+            opaque = true;
+    }
+}
+
+bool key_constraint::numeric_eq() const {
+    return has_eq && is_number(eq);
+}
+
+std::pair<bound, bound> key_constraint::interval() const {
+    bound lo = lower, hi = upper;
+
+    if (numeric_eq()) {
+        double v = as<double>(eq);
+        if (v > lo.value || (v == lo.value && lo.closed)) lo = bound(v, true);
+        if (v < hi.value || (v == hi.value && hi.closed)) hi = bound(v, true);
+    }
+
+    if (integral) {
+        lo = bound(lo.closed ? std::ceil(lo.value) : std::floor(lo.value) + 1, true);
+        hi = bound(hi.closed ? std::floor(hi.value) : std::ceil(hi.value) - 1, true);
+    }
+
+    return std::make_pair(lo, hi);
+}
+
+bool key_constraint::satisfiable() const {
+    if (conflict) return false;
+    if (opaque) return true;
+
+    if (has_eq && std::find(neq.begin(), neq.end(), eq) != neq.end())
+        return false;
+
+    // a string compared against numeric bounds; leave that to mapnik
+    if (has_eq && !numeric_eq()) return true;
+
+    interval_type i = interval();
+    if (is_empty(i)) return false;
+
+    if (i.first.value == i.second.value) {
+        for (std::vector<utree>::const_iterator it = neq.begin(); it != neq.end(); ++it) {
+            if (is_number(*it) && as<double>(*it) == i.first.value)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool key_constraint::implies(key_constraint const& other) const {
+    if (!satisfiable()) return true;
+
+    if (opaque || other.opaque) {
+        for (std::vector<filter_selector>::const_iterator it = other.filters.begin();
+             it != other.filters.end();
+             ++it) {
+            if (std::find(filters.begin(), filters.end(), *it) == filters.end())
+                return false;
+        }
+        return true;
+    }
+
+    if (other.has_eq && !other.numeric_eq())
+        return has_eq && eq == other.eq;
+
+    interval_type ti = interval();
+
+    if (has_eq && !numeric_eq()) {
+        // only a non-numeric value is allowed, other can't restrict the
+        // numeric range without excluding it as well
+        interval_type oi = other.interval();
+        if (!contains(oi, ti)) return false;
+    } else if (!contains(other.interval(), ti)) {
+        return false;
+    }
+
+    for (std::vector<utree>::const_iterator it = other.neq.begin(); it != other.neq.end(); ++it) {
+        if (has_eq && !(eq == *it)) continue;
+        if (std::find(neq.begin(), neq.end(), *it) != neq.end()) continue;
+        if (is_number(*it) && !(has_eq && !numeric_eq()) && !contains(ti, as<double>(*it))) continue;
+        return false;
+    }
+
+    return true;
+}
+
+static void add_filters(constraints_type &constraints, rule::filters_type const& filters) {
+    for (rule::filters_type::const_iterator it = filters.begin();
+         it != filters.end();
+         ++it) {
+        constraints_type::iterator c = constraints.find(it->key);
+        if (c == constraints.end()) {
+            c = constraints.insert(std::make_pair(it->key, key_constraint())).first;
+            c->second.integral = key_constraint::is_integral_key(it->key);
+        }
+        c->second.add(*it);
+    }
+}
+
+static bool satisfiable(constraints_type const& constraints) {
+    for (constraints_type::const_iterator it = constraints.begin();
+         it != constraints.end();
+         ++it) {
+        if (!it->second.satisfiable()) return false;
+    }
+
+    return true;
+}
+
+constraints_type analyse_filters(rule::filters_type const& filters) {
+    constraints_type constraints;
+    add_filters(constraints, filters);
+    return constraints;
+}
+
+bool filters_satisfiable(rule::filters_type const& filters) {
+    return satisfiable(analyse_filters(filters));
+}
+
+bool filters_compatible(rule::filters_type const& lhs, rule::filters_type const& rhs) {
+    constraints_type constraints;
+    add_filters(constraints, lhs);
+    add_filters(constraints, rhs);
+    return satisfiable(constraints);
+}
+
+bool filters_imply(rule::filters_type const& lhs, rule::filters_type const& rhs) {
+    constraints_type lc = analyse_filters(lhs),
+                     rc = analyse_filters(rhs);
+
+    for (constraints_type::const_iterator it = lc.begin(); it != lc.end(); ++it) {
+        if (!it->second.satisfiable()) return true;
+    }
+
+    for (constraints_type::const_iterator it = rc.begin(); it != rc.end(); ++it) {
+        constraints_type::const_iterator l = lc.find(it->first);
+
+        if (l == lc.end() || !l->second.implies(it->second))
+            return false;
+    }
+
+    return true;
+}
+
+} }
@@ -10,11 +10,17 @@ namespace carto { namespace intermediate {
 mss_parser::mss_parser(parse_tree const& pt, bool strict_, std::string const& path_)
   : tree(pt),
     strict(strict_),
-    path(path_) { }
+    path(path_),
+    variant(0),
+    stats(0),
+    trace(0) { }
   
 mss_parser::mss_parser(std::string const& in, bool strict_, std::string const& path_)
   : strict(strict_),
-    path(path_) 
+    path(path_),
+    variant(0),
+    stats(0),
+    trace(0)
 {
     typedef position_iterator<std::string::const_iterator> iter;
     tree = build_parse_tree<carto_parser<iter> >(in, path);
@@ -39,10 +45,31 @@ struct filter_diff_pred {
     }
 };
 
+// rules without attributes are never emitted
+static std::size_t emitted_rules(stylesheet const& styl) {
+    std::size_t n = 0;
+    for(stylesheet::rules_type::const_iterator it = styl.rules.begin();
+        it != styl.rules.end();
+        ++it) {
+        if (!it->attrs.empty()) ++n;
+    }
+    return n;
+}
+
 void mss_parser::parse_stylesheet(stylesheet &styl, style_env &env) {
     using spirit::utree_type;
 
+    if (variant) {
+        typedef style_variant::vars_type::const_iterator var_iter;
+        for (var_iter it = variant->vars.begin(); it != variant->vars.end(); ++it)
+            env.vars.define(it->first, import_value(it->second, variant->annotations));
+    }
+
+    count_stat(stats, "annotations", tree.annotations().size());
+
     utree const& root_node = tree.ast();
+    stat_timer evaluate_timer(stats, "evaluate");
+    trace_scope evaluate_trace(trace, "evaluate", path);
 
     for (utree::const_iterator it = root_node.begin();
          it != root_node.end();
@@ -70,7 +97,22 @@ void mss_parser::parse_stylesheet(stylesheet &styl, style_env &env) {
         }
      }
 
-    cascade(styl);
+    evaluate_timer.stop();
+    evaluate_trace.stop();
+
+    trace_scope cascade_trace(trace, "cascade", path);
+
+    if (stats) {
+        count_stat(stats, "rules before cascade", emitted_rules(styl));
+        
+        stat_timer cascade_timer(stats, "cascade");
+        cascade(styl);
+        cascade_timer.stop();
+        
+        count_stat(stats, "rules after cascade", emitted_rules(styl));
+    } else {
+        cascade(styl);
+    }
 }
 
 void mss_parser::cascade(stylesheet &styl) {
@@ -370,6 +412,7 @@ utree mss_parser::eval_var(utree const& node,
                                         style_env const& env) {
     std::string key = as<std::string>(node.front());
     
+    count_stat(stats, "variable lookups");
     utree value = env.vars.lookup(key);
     
     if (value == utree::nil_type()) {
@@ -388,7 +431,7 @@ utree mss_parser::parse_value(utree const& node,
         return eval_var(node, env); // vars can point at other vars
     } else if (get_node_type(node) == carto_expression) {
         //BOOST_ASSERT(node.size()==1);
-        expression exp(node.front().front(), tree.annotations(), env);
+        expression exp(node.front().front(), tree.annotations(), env, stats);
         return exp.eval();
     } else {
         if (node.size() == 1)
@@ -413,6 +456,10 @@ void mss_parser::parse_attribute(stylesheet &map,
 void mss_parser::parse_variable(utree const& node,
                                              style_env& env) {
     std::string name = as<std::string>(node.front());
+    
+    if (variant && variant->vars.count(name))
+        return;
+    
     utree val = parse_value(node.back(), env);
     env.vars.define(name, val);
 }
@@ -430,6 +477,26 @@ void mss_parser::parse_map_style(stylesheet &styl,
     }
 }
 
+utree mss_parser::import_value(utree const& value, annotations_type const& from) {
+    using spirit::utree_type;
+    
+    utree ut;
+    
+    if (value.which() == utree_type::list_type) {
+        for (utree::const_iterator it = value.begin(); it != value.end(); ++it)
+            ut.push_back(import_value(*it, from));
+    } else {
+        ut = value;
+    }
+    
+    if (value.tag()) {
+        tree.annotations().push_back(from[value.tag()]);
+        ut.tag(tree.annotations().size() - 1);
+    }
+    
+    return ut;
+}
+
 mss_parser mss_parser::load(std::string filename, bool strict) {
     std::ifstream file(filename.c_str(), std::ios_base::in);
 
@@ -1,4 +1,5 @@
 #include <intermediate/mss_to_mapnik.hpp>
+#include <intermediate/filter_analysis.hpp>
 
 #include <utility/utree.hpp>
 #include <utility/version.hpp>
@@ -20,6 +21,10 @@
 
 #include <agg_trans_affine.h>
 
+#include <algorithm>
+#include <limits>
+#include <iostream>
+
 namespace carto { namespace intermediate {
 
 static 
@@ -32,17 +37,159 @@ double const zoom_ranges[] = { 1000000000, 500000000, 200000000, 100000000,
 
 using carto::detail::as;
 
-mss_to_mapnik::mss_to_mapnik(mapnik::Map &m) : map_(m) { }
+std::pair<double, double> zoom_scale_range(unsigned zoom) {
+    return std::make_pair(zoom_ranges[zoom + 1], zoom_ranges[zoom]);
+}
+
+mss_to_mapnik::mss_to_mapnik(mapnik::Map &m, bool merge_zooms)
+  : map_(m),
+    merge_zooms_(merge_zooms),
+    emitted_(),
+    merged_(0),
+    filter_order_(order_by_key),
+    selectivity_(0),
+    conditions_(0),
+    fold_values_(false),
+    folded_(0),
+    rule_names_(0),
+    rule_hits_(0),
+    reordered_(0),
+    symbolizers_(0),
+    signatures_(0),
+    touched_(),
+    log_(&std::clog),
+    stats_(0) { }
+
+std::size_t mss_to_mapnik::merged_rules() const {
+    return merged_;
+}
+
+void mss_to_mapnik::set_fold_values(bool fold_values) {
+    fold_values_ = fold_values;
+}
+
+std::size_t mss_to_mapnik::folded_rules() const {
+    return folded_;
+}
+
+void mss_to_mapnik::record_rules(rule_names_type *names) {
+    rule_names_ = names;
+}
+
+void mss_to_mapnik::set_rule_hits(rule_hits_type const* hits) {
+    rule_hits_ = hits;
+}
+
+std::size_t mss_to_mapnik::reordered_rules() const {
+    return reordered_;
+}
+
+void mss_to_mapnik::record_symbolizers(symbolizer_counts_type *counts) {
+    symbolizers_ = counts;
+}
+
+void mss_to_mapnik::record_signatures(style_signatures_type *signatures) {
+    signatures_ = signatures;
+}
+
+// the symbolizer an attribute goes to, in the order visit(rule) tries them
+static std::string symbolizer_type(std::string const& key) {
+    static char const* const prefixes[] = {
+        "polygon-", "line-", "marker-", "point-", "line-pattern-",
+        "polygon-pattern-", "raster-", "building-", "text-", "shield-"
+    };
+
+    for(std::size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i) {
+        std::string prefix(prefixes[i]);
+        if (key.compare(0, prefix.size(), prefix) == 0)
+            return prefix;
+    }
+
+    return key;
+}
+
+std::vector<std::string> mss_to_mapnik::symbolizer_keys(rule::attributes_type const& attrs) {
+    std::map<std::string, std::string> symbolizers;
+
+    for(rule::attributes_type::const_iterator it = attrs.begin();
+        it != attrs.end();
+        ++it) {
+        std::stringstream oss;
+        oss << it->first << ":" << it->second << ";";
+        symbolizers[symbolizer_type(it->first)] += oss.str();
+    }
+
+    std::vector<std::string> keys;
+    for(std::map<std::string, std::string>::const_iterator it = symbolizers.begin();
+        it != symbolizers.end();
+        ++it) {
+        keys.push_back(it->second);
+    }
+
+    return keys;
+}
+
+void mss_to_mapnik::sign_style(std::string const& name) {
+    std::string &signature = (*signatures_)[name];
+    signature.clear();
+
+    mapnik::Map::style_iterator style_it = map_.styles().find(name);
+    emitted_type::const_iterator e_it = emitted_.find(name);
+    if (style_it == map_.styles().end()) return;
+
+    mapnik::feature_type_style::rules const& rules = (*style_it).second.get_rules();
+    std::size_t emitted = e_it == emitted_.end() ? 0 : e_it->second.size();
+
+    // rules from other stylesheets are only known to mapnik
+    if (rules.size() != emitted) return;
+
+    std::stringstream oss;
+    for(std::size_t i = 0; i < emitted; ++i) {
+        emitted_rule const& rule = e_it->second[i];
+        mapnik::rule const& r = rules[rule.index];
+
+        oss << "rule " << r.get_min_scale() << " " << r.get_max_scale() << " "
+            << mapnik::to_expression_string(*r.get_filter()) << "\n";
+
+        std::vector<std::string> keys = symbolizer_keys(rule.attrs);
+        for(std::size_t k = 0; k < keys.size(); ++k)
+            oss << keys[k] << "\n";
+    }
+
+    signature = oss.str();
+}
+
+void mss_to_mapnik::set_filter_order(filter_order order, selectivity_type const* selectivity) {
+    filter_order_ = order;
+    selectivity_ = selectivity;
+}
+
+void mss_to_mapnik::record_conditions(conditions_type *conditions) {
+    conditions_ = conditions;
+}
+
+void mss_to_mapnik::set_log(std::ostream *log) {
+    log_ = log;
+}
+
+void mss_to_mapnik::set_stats(compile_stats *stats) {
+    stats_ = stats;
+}
+
+mapnik::expression_ptr mss_to_mapnik::parse_expression(std::string const& str) {
+    count_stat(stats_, "parse_expression calls");
+    return mapnik::parse_expression(str, "utf8");
+}
 
 mapnik::transform_type mss_to_mapnik::create_transform(std::string const& str)
 {
     agg::trans_affine tr;
-    if (!mapnik::svg::parse_transform(str.c_str(),tr))
+    if (!mapnik::svg::parse_transform(str.c_str(),tr) && log_)
     {
         std::stringstream err;
         err << "Could not parse transform from '" << str 
             << "', expected string like: 'matrix(1, 0, 0, 1, 0, 0)'";
-        std::clog << "### WARNING: " << err << std::endl;         
+        *log_ << "### WARNING: " << err.str() << std::endl;
     }
     mapnik::transform_type matrix;
     tr.store_to(&matrix[0]);
@@ -215,7 +362,7 @@ void mss_to_mapnik::emit_building(std::string const& key, utree const& value) {
     } else if (key == "building-fill-opacity") {
         s->set_opacity(as<double>(value));
     } else if (key == "building-height") {
-        s->set_height(mapnik::parse_expression(as<std::string>(value)));
+        s->set_height(parse_expression(as<std::string>(value)));
     } else {
         throw generation_error("Unknown key: " + key);
     }
@@ -258,7 +405,7 @@ void mss_to_mapnik::emit_text(std::string const& key, utree const& value) {
             map_.insert_fontset(name, fs);
         }
     } else if (key == "text-name") {
-        s->set_name(mapnik::parse_expression(as<std::string>(value)));
+        s->set_name(parse_expression(as<std::string>(value)));
     } else if (key == "text-size") {
         s->set_text_size(round(as<double>(value)));
     } else if (key == "text-ratio") {
@@ -324,7 +471,7 @@ void mss_to_mapnik::emit_shield(std::string const& key, utree const& value) {
     mapnik::shield_symbolizer *s = find_symbolizer<mapnik::shield_symbolizer>();
     
     if (key == "shield-name") {
-        s->set_name(mapnik::parse_expression(as<std::string>(value)));
+        s->set_name(parse_expression(as<std::string>(value)));
     } else if (key == "shield-face-name") {
         s->set_face_name(as<std::string>(value));
     } else if (key == "shield-size") {
@@ -425,99 +572,375 @@ void mss_to_mapnik::emit_map_style(stylesheet::map_style_type const& map_style)
     map_.set_extra_attributes(extra_attr);
 }
 
+// rough relative cost for mapnik to evaluate a condition on a feature
+static unsigned filter_cost(filter_selector const& filter) {
+    using boost::spirit::utree_type;
+
+    switch(filter.value.which()) {
+        case utree_type::double_type:
+        case utree_type::int_type:
+        case utree_type::bool_type:
+        case utree_type::nil_type:
+            return 0;
+
+        case utree_type::string_type:
+        case utree_type::symbol_type:
+            if (filter.pred == filter_selector::pred_eq ||
+                filter.pred == filter_selector::pred_neq)
+                return 1;
+            return 2;
+
+        default:
+            return 2;
+    }
+}
+
+// the mapnik expression for a condition on a feature attribute
+static std::string filter_condition(filter_selector const& filter) {
+    std::stringstream foss;
+    foss << "[" << filter.key << "]";
+
+    switch(filter.pred) {
+        case filter_selector::pred_eq:
+            foss << "=";
+            break;
+        case filter_selector::pred_lt:
+            foss << "<";
+            break;
+        case filter_selector::pred_le:
+            foss << "<=";
+            break;
+        case filter_selector::pred_gt:
+            foss << ">";
+            break;
+        case filter_selector::pred_ge:
+            foss << ">=";
+            break;
+        case filter_selector::pred_neq:
+            foss << "!=";
+            break;
+        case filter_selector::pred_unknown:
+        default:
+            throw generation_error("bad predicate");
+    }
+
+    foss << stringify_filter_value(filter.value);
+    return foss.str();
+}
+
+mss_to_mapnik::emitted_filter mss_to_mapnik::make_condition(unsigned cost, std::string const& expr) const {
+    double selectivity = 1;
+    if (selectivity_) {
+        selectivity_type::const_iterator s_it = selectivity_->find(expr);
+        if (s_it != selectivity_->end())
+            selectivity = s_it->second;
+    }
+
+    return emitted_filter(cost, selectivity, expr);
+}
+
+mapnik::expression_ptr mss_to_mapnik::build_filter(std::vector<emitted_filter> &conditions) {
+    // mapnik stops evaluating "and" at the first false operand
+    if (filter_order_ == order_by_cost)
+        std::stable_sort(conditions.begin(), conditions.end());
+
+    std::vector<std::string> exprs;
+    for(std::vector<emitted_filter>::const_iterator it = conditions.begin();
+        it != conditions.end();
+        ++it) {
+        exprs.push_back(it->expr);
+    }
+
+    rule_conditions_ = exprs;
+
+    std::stringstream oss;
+    oss << "(" << boost::algorithm::join(exprs, ") and (") << ")";
+
+    return parse_expression(oss.str());
+}
+
 void mss_to_mapnik::emit_filters(rule::filters_type const& filters) {
+    rule_conditions_.clear();
+
     if(!filters.size()) return;
 
-    std::vector<std::string> emit_filters;
+    std::vector<emitted_filter> emit_filters;
 
     for(rule::filters_type::const_iterator it = filters.begin();
         it != filters.end();
         ++it) {
-        std::stringstream foss;
+        if(it->key == "zoom") {
+            int b = as<int>(it->value);
 
-        switch(it->pred) {
-            case filter_selector::pred_eq:
-                if(it->key == "zoom") {
-                    int b = as<int>(it->value);
+            switch(it->pred) {
+                case filter_selector::pred_eq:
                     rule_->set_min_scale(zoom_ranges[b + 1]);
                     rule_->set_max_scale(zoom_ranges[b]);
-                    continue;
-                } else {
-                    foss << "[" << it->key << "]="
-                         << stringify_filter_value(it->value);
-                }
-                break;
-
-            case filter_selector::pred_lt:
-                if(it->key == "zoom") {
-                    int b = as<int>(it->value);
-                    rule_->set_min_scale(zoom_ranges[b - 1]);
-                    continue;
-                } else {
-                    foss << "[" << it->key << "]<"
-                         << stringify_filter_value(it->value);
-                }
-                break;
-
-            case filter_selector::pred_le:
-                if(it->key == "zoom") {
-                    int b = as<int>(it->value);
+                    break;
+                case filter_selector::pred_lt:
                     rule_->set_min_scale(zoom_ranges[b]);
-                    continue;
-                } else {
-                    foss << "[" << it->key << "]<="
-                         << stringify_filter_value(it->value);
-                }
-                break;
-
-            case filter_selector::pred_gt:
-                if(it->key == "zoom") {
-                    int b = as<int>(it->value);
+                    break;
+                case filter_selector::pred_le:
+                    rule_->set_min_scale(zoom_ranges[b + 1]);
+                    break;
+                case filter_selector::pred_gt:
                     rule_->set_max_scale(zoom_ranges[b + 1]);
-                    continue;
-                } else {
-                    foss << "[" << it->key << "]>"
-                         << stringify_filter_value(it->value);
-                }
-                break;
-
-            case filter_selector::pred_ge:
-                if(it->key == "zoom") {
-                    int b = as<int>(it->value);
+                    break;
+                case filter_selector::pred_ge:
                     rule_->set_max_scale(zoom_ranges[b]);
-                    continue;
-                } else {
-                    foss << "[" << it->key << "]>="
-                         << stringify_filter_value(it->value);
-                }
-                break;
-
-            case filter_selector::pred_neq:
-                if(it->key == "zoom") {
+                    break;
+                case filter_selector::pred_neq:
                     throw generation_error("!= unsupported for zoom");
-                } else {
-                    foss << "[" << it->key << "]!="
-                         << stringify_filter_value(it->value);
-                }
-                break;
-
-            case filter_selector::pred_unknown:
-            default:
-                throw generation_error("bad predicate");
-                
+                case filter_selector::pred_unknown:
+                default:
+                    throw generation_error("bad predicate");
+            }
+
+            continue;
         }
 
-        if(!foss.str().empty())
-            emit_filters.push_back(foss.str());
+        emit_filters.push_back(make_condition(filter_cost(*it), filter_condition(*it)));
     }
 
     if(!emit_filters.size()) return;
 
-    std::stringstream oss;
-    oss << "(" << boost::algorithm::join(emit_filters, ") and (") << ")";
+    rule_->set_filter(build_filter(emit_filters));
+}
+
+// splits off the zoom filters of a rule as a range of whole zoom levels,
+// fails for anything that isn't one
+static bool split_zoom(rule::filters_type const& filters, rule::filters_type &others,
+                       double &min_zoom, double &max_zoom)
+{
+    rule::filters_type zoom;
+
+    for(rule::filters_type::const_iterator it = filters.begin();
+        it != filters.end();
+        ++it) {
+        if (it->key == "zoom")
+            zoom.insert(*it);
+        else
+            others.insert(*it);
+    }
+
+    min_zoom = -std::numeric_limits<double>::infinity();
+    max_zoom = std::numeric_limits<double>::infinity();
+
+    if (zoom.empty()) return true;
+
+    constraints_type constraints = analyse_filters(zoom);
+    key_constraint const& z = constraints["zoom"];
+    if (z.opaque || !z.neq.empty() || (z.has_eq && !z.numeric_eq()))
+        return false;
+
+    std::pair<key_constraint::bound, key_constraint::bound> range = z.interval();
+    min_zoom = range.first.value;
+    max_zoom = range.second.value;
+
+    return true;
+}
+
+bool mss_to_mapnik::track_rule(mapnik::feature_type_style &style, rule const& rule) {
+    std::string name = rule.get_partial_name();
+    std::vector<emitted_rule> &emitted = emitted_[name];
+
+    emitted_rule current;
+    current.selector = rule.get_selector_name();
+    current.attrs = rule.attrs;
+    current.index = style.get_rules().size();
+    current.sources.push_back(rule.filters);
+
+    bool mergeable = split_zoom(rule.filters, current.filters, current.min_zoom, current.max_zoom);
+    if (!mergeable)
+        current.filters = rule.filters;
+
+    for(std::size_t i = 0; (merge_zooms_ || fold_values_) && mergeable && i < emitted.size(); ++i) {
+        emitted_rule &prev = emitted[i];
+
+        if (prev.attrs != current.attrs)
+            continue;
+
+        bool zooms = merge_zooms_ && prev.alternatives.empty() &&
+                     prev.filters == current.filters &&
+                     // the union of both ranges has to be a range again
+                     current.min_zoom <= prev.max_zoom + 1 &&
+                     prev.min_zoom <= current.max_zoom + 1;
+
+        bool values = fold_values_ && !zooms &&
+                      prev.min_zoom == current.min_zoom &&
+                      prev.max_zoom == current.max_zoom;
+
+        if (!zooms && !values) continue;
+
+        // under FILTER_FIRST, moving this rule up to prev must not take
+        // features away from the rules emitted in between
+        bool safe = true;
+        for(std::size_t k = i + 1; safe && k < emitted.size(); ++k) {
+            if (emitted[k].attrs == current.attrs) continue;
+            safe = exclusive(emitted[k], current);
+        }
+
+        if (!safe) continue;
+
+        if (zooms) {
+            mapnik::rule &target = style.get_rules_nonconst()[prev.index];
+            target.set_min_scale(std::min(target.get_min_scale(), rule_->get_min_scale()));
+            target.set_max_scale(std::max(target.get_max_scale(), rule_->get_max_scale()));
+
+            prev.min_zoom = std::min(prev.min_zoom, current.min_zoom);
+            prev.max_zoom = std::max(prev.max_zoom, current.max_zoom);
+            ++merged_;
+        } else if (fold_value(style, prev, current)) {
+            ++folded_;
+        } else {
+            continue;
+        }
+
+        prev.sources.push_back(rule.filters);
+        return true;
+    }
+
+    emitted.push_back(current);
+
+    if (rule_names_)
+        (*rule_names_)[name].push_back(current.selector);
+
+    return false;
+}
+
+// the filters in lhs that aren't in rhs
+static std::vector<filter_selector> filters_difference(rule::filters_type const& lhs,
+                                                       rule::filters_type const& rhs)
+{
+    std::vector<filter_selector> diff;
+
+    for(rule::filters_type::const_iterator it = lhs.begin();
+        it != lhs.end();
+        ++it) {
+        if (std::find(rhs.begin(), rhs.end(), *it) == rhs.end())
+            diff.push_back(*it);
+    }
+
+    return diff;
+}
+
+bool mss_to_mapnik::fold_value(mapnik::feature_type_style &style, emitted_rule &prev,
+                               emitted_rule const& current)
+{
+    std::vector<filter_selector> removed = filters_difference(prev.filters, current.filters),
+                                 added   = filters_difference(current.filters, prev.filters);
 
-    mapnik::expression_ptr expr = mapnik::parse_expression(oss.str(), "utf8");
-    rule_->set_filter(expr);
+    if (added.size() != 1 || added.front().pred != filter_selector::pred_eq)
+        return false;
+
+    if (prev.alternatives.empty()) {
+        if (removed.size() != 1 ||
+            removed.front().pred != filter_selector::pred_eq ||
+            removed.front().key != added.front().key)
+            return false;
+
+        prev.alternatives.push_back(removed.front());
+
+        rule::filters_type common;
+        for(rule::filters_type::const_iterator it = prev.filters.begin();
+            it != prev.filters.end();
+            ++it) {
+            if (!(*it == removed.front())) common.insert(*it);
+        }
+        prev.filters.swap(common);
+    } else if (!removed.empty() || prev.alternatives.front().key != added.front().key) {
+        return false;
+    }
+
+    if (std::find(prev.alternatives.begin(), prev.alternatives.end(), added.front()) == prev.alternatives.end())
+        prev.alternatives.push_back(added.front());
+
+    std::vector<emitted_filter> conditions;
+    for(rule::filters_type::const_iterator it = prev.filters.begin();
+        it != prev.filters.end();
+        ++it) {
+        conditions.push_back(make_condition(filter_cost(*it), filter_condition(*it)));
+    }
+
+    // mapnik 2.0 has no set membership test, so spell it out
+    std::vector<std::string> alternatives;
+    unsigned cost = 0;
+    double selectivity = 0;
+    for(std::vector<filter_selector>::const_iterator it = prev.alternatives.begin();
+        it != prev.alternatives.end();
+        ++it) {
+        emitted_filter alternative = make_condition(filter_cost(*it), filter_condition(*it));
+        alternatives.push_back(alternative.expr);
+        cost = std::max(cost, alternative.cost);
+        selectivity += alternative.selectivity;
+    }
+
+    conditions.push_back(emitted_filter(cost, std::min(selectivity, 1.0),
+        "(" + boost::algorithm::join(alternatives, ") or (") + ")"));
+
+    style.get_rules_nonconst()[prev.index].set_filter(build_filter(conditions));
+    return true;
+}
+
+bool mss_to_mapnik::exclusive(emitted_rule const& lhs, emitted_rule const& rhs) {
+    for(std::vector<rule::filters_type>::const_iterator l_it = lhs.sources.begin();
+        l_it != lhs.sources.end();
+        ++l_it) {
+        for(std::vector<rule::filters_type>::const_iterator r_it = rhs.sources.begin();
+            r_it != rhs.sources.end();
+            ++r_it) {
+            if (filters_compatible(*l_it, *r_it))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+std::size_t mss_to_mapnik::rule_hits(std::string const& style, emitted_rule const& rule) const {
+    rule_hits_type::const_iterator s_it = rule_hits_->find(style);
+    if (s_it == rule_hits_->end()) return 0;
+
+    std::map<std::string, std::size_t>::const_iterator r_it = s_it->second.find(rule.selector);
+    return r_it == s_it->second.end() ? 0 : r_it->second;
+}
+
+void mss_to_mapnik::reorder_rules(std::string const& name, std::vector<emitted_rule> &emitted) {
+    mapnik::Map::style_iterator style_it = map_.styles().find(name);
+    if (style_it == map_.styles().end() || emitted.empty()) return;
+
+    std::vector<std::size_t> hits;
+    for(std::size_t i = 0; i < emitted.size(); ++i)
+        hits.push_back(rule_hits(name, emitted[i]));
+
+    // insertion sort by hits, only ever swapping neighbours no feature can
+    // match both of, so FILTER_FIRST picks the same rule for every feature
+    std::vector<std::size_t> order;
+    for(std::size_t i = 0; i < emitted.size(); ++i) {
+        std::size_t pos = order.size();
+        while(pos > 0 &&
+              hits[order[pos - 1]] < hits[i] &&
+              exclusive(emitted[order[pos - 1]], emitted[i])) {
+            --pos;
+        }
+
+        if (pos != order.size()) ++reordered_;
+        order.insert(order.begin() + pos, i);
+    }
+
+    // this generator's rules are the tail of the style's rules
+    mapnik::feature_type_style::rules &rules = (*style_it).second.get_rules_nonconst();
+    mapnik::feature_type_style::rules original(rules);
+    std::size_t base = emitted.front().index;
+
+    std::vector<emitted_rule> sorted;
+    for(std::size_t i = 0; i < order.size(); ++i) {
+        rules[base + i] = original[emitted[order[i]].index];
+        sorted.push_back(emitted[order[i]]);
+        sorted.back().index = base + i;
+    }
+
+    emitted.swap(sorted);
 }
 
 void mss_to_mapnik::visit(stylesheet const& styl) {
@@ -528,6 +951,16 @@ void mss_to_mapnik::visit(stylesheet const& styl) {
         ++it) {
         visit(*it);
     }
+
+    if (rule_hits_) {
+        for(emitted_type::iterator it = emitted_.begin(); it != emitted_.end(); ++it)
+            reorder_rules(it->first, it->second);
+    }
+
+    if (signatures_) {
+        for(std::set<std::string>::const_iterator it = touched_.begin(); it != touched_.end(); ++it)
+            sign_style(*it);
+    }
 }
 
 void mss_to_mapnik::visit(rule const& rule) {
@@ -546,9 +979,15 @@ void mss_to_mapnik::visit(rule const& rule) {
         style_it = map_.styles().find(name);
     }
 
+    if (signatures_)
+        touched_.insert(name);
+
     rule_ = mapnik::rule();
     emit_filters(rule.filters);
 
+    if (conditions_ && rule.attrs.size())
+        (*conditions_)[name].insert(rule_conditions_.begin(), rule_conditions_.end());
+
     if(rule.attrs.size())
     {
         for(rule::attributes_type::const_iterator it = rule.attrs.begin();
@@ -579,6 +1018,16 @@ void mss_to_mapnik::visit(rule const& rule) {
                 throw generation_error("Unknown key: " + key);
         }
 
+        if ((merge_zooms_ || fold_values_ || rule_names_ || rule_hits_ || signatures_) &&
+            track_rule((*style_it).second, rule))
+            return;
+
+        if (symbolizers_) {
+            std::vector<std::string> keys = symbolizer_keys(rule.attrs);
+            for(std::size_t k = 0; k < keys.size(); ++k)
+                ++(*symbolizers_)[keys[k]];
+        }
+
         (*style_it).second.add_rule(*rule_);
     }
 }
@@ -0,0 +1,74 @@
+#include <intermediate/rule_pruner.hpp>
+#include <intermediate/filter_analysis.hpp>
+
+#include <map>
+
+namespace carto { namespace intermediate {
+
+std::string rule_pruner::removal::get_string() const {
+    switch(reason) {
+        case empty:
+            return selector + " has no attributes";
+        case unsatisfiable:
+            return selector + " has contradicting filters";
+        case shadowed:
+            return selector + " is shadowed by " + shadowed_by;
+    }
+    return selector;
+}
+
+rule_pruner::rule_pruner(report_type &report) : report(report) { }
+
+void rule_pruner::prune(stylesheet &styl) {
+    typedef stylesheet::rules_type::iterator rule_iter;
+    typedef std::map<std::string, std::vector<rule_iter> > styles_type;
+
+    // rules that made it into each style so far, in emission order
+    styles_type kept;
+    std::vector<rule_iter> removed;
+
+    // mss_to_mapnik emits the most specific rules first, walk them in the
+    // same order so a rule is only ever compared to those ahead of it
+    for(stylesheet::rules_type::reverse_iterator it = styl.rules.rbegin();
+        it != styl.rules.rend();
+        ++it) {
+        rule_iter rule_it = --it.base();
+
+        if (it->attrs.empty()) {
+            report.push_back(removal(it->get_selector_name(), empty));
+            removed.push_back(rule_it);
+            continue;
+        }
+
+        if (!filters_satisfiable(it->filters)) {
+            report.push_back(removal(it->get_selector_name(), unsatisfiable));
+            removed.push_back(rule_it);
+            continue;
+        }
+
+        std::vector<rule_iter> &style = kept[it->get_partial_name()];
+        std::vector<rule_iter>::const_iterator prev = style.begin();
+
+        for(; prev != style.end(); ++prev) {
+            if (filters_imply(it->filters, (*prev)->filters))
+                break;
+        }
+
+        if (prev != style.end()) {
+            report.push_back(removal(it->get_selector_name(), shadowed,
+                                     (*prev)->get_selector_name()));
+            removed.push_back(rule_it);
+            continue;
+        }
+
+        style.push_back(rule_it);
+    }
+
+    for(std::vector<rule_iter>::const_iterator it = removed.begin();
+        it != removed.end();
+        ++it) {
+        styl.rules.erase(*it);
+    }
+}
+
+} }
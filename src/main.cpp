@@ -1,5 +1,7 @@
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <vector>
 
 //#define BOOST_SPIRIT_DEBUG
 
@@ -14,6 +16,15 @@
 
 #include <mml_parser.hpp>
 #include <mss_parser.hpp>
+#include <deferred_datasource.hpp>
+#include <feature_sampler.hpp>
+#include <zoom_bands.hpp>
+#include <style_variant.hpp>
+#include <compile_server.hpp>
+#include <batch_compiler.hpp>
+#include <utility/stats.hpp>
+#include <utility/alloc_stats.hpp>
+#include <utility/trace.hpp>
 
 #include <intermediate/dumper.hpp>
 #include <intermediate/mss_parser.hpp>
@@ -28,6 +39,90 @@
 #include <boost/spirit/include/qi.hpp>
 #include <position_iterator.hpp>
 
+namespace po = boost::program_options;
+
+static void configure(carto::mml_parser& parser, po::variables_map const& vm)
+{
+    parser.lazy_datasources = vm.count("lazy-datasources");
+    parser.infer_zooms = vm.count("infer-layer-zooms");
+    parser.project_columns = vm.count("project-columns");
+    parser.prune_rules = vm.count("prune-rules");
+    parser.merge_zooms = vm.count("merge-zooms");
+    parser.fold_values = vm.count("fold-values");
+    parser.share_styles = vm.count("share-styles");
+    
+    if (vm.count("dump"))
+        parser.dump = &std::clog;
+    
+    if (vm.count("order-filters") || vm.count("sample-filters"))
+        parser.filter_order = carto::intermediate::order_by_cost;
+}
+
+static void report_symbolizers(carto::intermediate::symbolizer_counts_type const& counts)
+{
+    typedef carto::intermediate::symbolizer_counts_type::const_iterator count_iter;
+    
+    std::size_t total = 0;
+    std::vector< std::pair<std::size_t, std::string> > repeated;
+    for (count_iter it = counts.begin(); it != counts.end(); ++it) {
+        total += it->second;
+        if (it->second > 1)
+            repeated.push_back(std::make_pair(it->second, it->first));
+    }
+    
+    if (!total) return;
+    
+    std::clog << "### NOTE: " << total << " symbolizers generated, "
+              << counts.size() << " distinct\n";
+    
+    std::sort(repeated.rbegin(), repeated.rend());
+    for (std::size_t i = 0; i < repeated.size() && i < 10; ++i) {
+        std::string key = repeated[i].second;
+        boost::algorithm::replace_all(key, "\n", " ");
+        if (key.size() > 72) key = key.substr(0, 69) + "...";
+        std::clog << "### NOTE:   " << repeated[i].first << "x " << key << "\n";
+    }
+}
+
+static carto::compile_options serve_options(po::variables_map const& vm)
+{
+    carto::compile_options options;
+    options.lazy_datasources = vm.count("lazy-datasources");
+    options.infer_zooms = vm.count("infer-layer-zooms");
+    options.project_columns = vm.count("project-columns");
+    options.prune_rules = vm.count("prune-rules");
+    options.merge_zooms = vm.count("merge-zooms");
+    options.fold_values = vm.count("fold-values");
+    options.share_styles = vm.count("share-styles");
+    options.order_filters = vm.count("order-filters");
+    return options;
+}
+
+// map.xml -> map.<suffix>.xml
+static std::string output_name(std::string const& output_file, std::string const& suffix)
+{
+    std::string::size_type ext = output_file.rfind('.');
+    if (ext == std::string::npos || output_file.find('/', ext) != std::string::npos)
+        ext = output_file.size();
+    
+    return output_file.substr(0, ext) + "." + suffix + output_file.substr(ext);
+}
+
+static bool save_map(mapnik::Map const& map, std::string const& file_name)
+{
+    std::ofstream file(file_name.c_str());
+    if (!file.is_open()) {
+        std::cout << "Error: could not save xml to: " << file_name << "\n";
+        return false;
+    }
+    file << mapnik::save_map_to_string(map, false);
+    file.close();
+    if (!file) {
+        std::cout << "Error: could not write xml to: " << file_name << "\n";
+        return false;
+    }
+    return true;
+}
 
 int main(int argc, char **argv) {
 
@@ -36,20 +131,55 @@ int main(int argc, char **argv) {
     std::string mapnik_dir = MAPNIKDIR;
     mapnik::datasource_cache::instance()->register_datasources(mapnik_dir); 
     
-    namespace po = boost::program_options;
-    
     std::string mapnik_input_dir = MAPNIKDIR;
     
-    std::string input_file, output_file;
+    std::string input_file, output_file, zoom_bands, socket_path, stats_format, trace_file, manifest_file;
+    std::vector<std::string> variant_files;
+    unsigned validate_jobs = 0,
+             jobs = 0;
+    std::size_t sample_limit = 0,
+                profile_limit = 0,
+                max_source = 0;
     
     po::options_description desc("carto");
     desc.add_options()
         ("help,h", "produce usage message")
         ("version,V","print version string")
         ("in", po::value<std::string>(&input_file),  "input carto file (mml or mss)")
-        ("out", po::value<std::string>(&output_file), "output xml file");
+        ("out", po::value<std::string>(&output_file), "output xml file")
+        ("dump", "print the intermediate form of every stylesheet to stderr")
+        ("stats", po::value<std::string>(&stats_format)->implicit_value("text"),
+         "print time spent per compile phase and counts of rules, variable lookups and expressions to stderr, as text or json")
+        ("alloc-stats", "print allocations, bytes allocated and peak live bytes per compile phase to stderr (scons alloc_stats=1 builds)")
+        ("trace", po::value<std::string>(&trace_file),
+         "write when every file parse, cascade, datasource and generation ran, on which thread, as Chrome trace_event json")
+        ("lazy-datasources", "don't create layer datasources while compiling")
+        ("infer-layer-zooms", "derive missing layer minzoom/maxzoom from style zoom filters")
+        ("project-columns", "select only the attributes styles use from SQL datasource tables")
+        ("prune-rules", "drop rules that can never match and report them")
+        ("merge-zooms", "merge rules that only differ in adjacent zoom ranges")
+        ("fold-values", "merge rules that only differ in one [key=value] filter into an or")
+        ("share-styles", "report duplicated symbolizers and replace identical styles by one")
+        ("order-filters", "order filter conditions cheapest first")
+        ("sample-filters", po::value<std::size_t>(&sample_limit)->implicit_value(1000),
+         "order filter conditions by cost, then by selectivity over N features per layer")
+        ("profile-data", po::value<std::size_t>(&profile_limit)->implicit_value(1000),
+         "move rules matching more of N sampled features per layer ahead of exclusive ones")
+        ("split-zooms", po::value<std::string>(&zoom_bands)->implicit_value(""),
+         "also write one map per zoom level, or per band as in 0-5,6-10,11-22, next to the output file")
+        ("variant", po::value< std::vector<std::string> >(&variant_files)->composing(),
+         "also compile the map with the @variables of this file, written next to the output file as map.<file name>.xml")
+        ("jobs,j", po::value<unsigned>(&jobs), "worker threads for variant compiles, --serve and --batch, one per core by default")
+        ("serve", po::value<std::string>(&socket_path),
+         "compile requests from clients of this unix socket until interrupted, see compile_server.hpp")
+        ("max-source", po::value<std::size_t>(&max_source)->default_value(64 << 20),
+         "largest inline source --serve reads, in bytes")
+        ("batch", po::value<std::string>(&manifest_file),
+         "compile every \"input.[mml|mss] output.xml\" line of this manifest file")
+        ("validate-datasources", po::value<unsigned>(&validate_jobs)->implicit_value(1),
+         "create and bind every layer datasource, using N worker threads");
     
-    std::string usage("\nusage: carto map.[mml|mss] [map.xml]");
+    std::string usage("\nusage: carto map.[mml|mss] [map.xml]\n       carto --serve socket\n       carto --batch manifest");
     
     po::positional_options_description p;
     p.add("in",1).add("out",1);
@@ -69,6 +199,56 @@ int main(int argc, char **argv) {
         std::cout << desc << usage << std::endl;
         return 1;
     }
+    
+    if (vm.count("serve"))
+    {
+        try {
+            // datasources and parse trees stay around for later requests
+            carto::compile_options options = serve_options(vm);
+            options.datasources.reset(new carto::datasource_pool());
+            options.cache.reset(new carto::parse_cache());
+            
+            carto::compile_server server(socket_path, options, jobs, max_source);
+            server.run();
+            
+            std::clog << "### NOTE: served " << server.requests() << " requests, "
+                      << options.cache->hits() << " parses cached, "
+                      << options.datasources->size() << " datasources created\n";
+        } catch (std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return 0;
+    }
+
+    if (vm.count("batch"))
+    {
+        try {
+            // stylesheets shared between projects are parsed once
+            carto::compile_options options = serve_options(vm);
+            options.cache.reset(new carto::parse_cache());
+            
+            std::vector<carto::batch_job> batch = carto::read_manifest(manifest_file);
+            std::size_t failed = carto::compile_batch(batch, options, jobs);
+            
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                for (std::size_t w = 0; w < batch[i].warnings.size(); ++w)
+                    std::clog << "### WARNING: " << batch[i].input << ": " << batch[i].warnings[w] << "\n";
+                if (!batch[i].error.empty())
+                    std::cerr << "Error: " << batch[i].input << ": " << batch[i].error << "\n";
+            }
+            
+            std::clog << "### NOTE: compiled " << batch.size() - failed << " of " << batch.size()
+                      << " projects, " << options.cache->hits() << " parses cached\n";
+            
+            if (failed)
+                return EXIT_FAILURE;
+        } catch (std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        return 0;
+    }
 
     if (!vm.count("in") 
          || (    !boost::algorithm::ends_with(input_file,".mml")
@@ -79,25 +259,209 @@ int main(int argc, char **argv) {
         std::cout << desc << usage << std::endl;
         return 1;
     }
+    
+    if (vm.count("stats") && stats_format != "text" && stats_format != "json")
+    {
+        std::cout << "Error: --stats is text or json\n";
+        return EXIT_FAILURE;
+    }
+    
+    if (vm.count("alloc-stats") && !carto::alloc_tracking_available())
+    {
+        std::cout << "Error: --alloc-stats needs carto built with scons alloc_stats=1\n";
+        return EXIT_FAILURE;
+    }
+    
+    if (!variant_files.empty() && (!vm.count("out") || !boost::algorithm::ends_with(input_file,".mml")))
+    {
+        std::cout << "Error: --variant needs an mml input and an output file\n";
+        return EXIT_FAILURE;
+    }
+    
+    if (vm.count("split-zooms") && !vm.count("out"))
+    {
+        std::cout << "Error: --split-zooms needs an output file\n";
+        return EXIT_FAILURE;
+    }
+    
+    std::vector<carto::zoom_band> bands;
+    if (vm.count("split-zooms"))
+    {
+        try {
+            bands = carto::parse_zoom_bands(zoom_bands);
+        } catch (std::exception& e) {
+            std::cout << "Error: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
 
 
     try {
         mapnik::Map m(800,600);
+        std::vector<carto::style_variant> variants;
+        std::vector<mapnik::Map> variant_maps;
+        std::vector<std::string> variant_errors;
+        
+        carto::compile_stats compile_stats;
+        carto::compile_stats *stats = vm.count("stats") || vm.count("alloc-stats") ? &compile_stats : 0;
+        
+        if (vm.count("alloc-stats"))
+            carto::enable_alloc_tracking();
+        
+        carto::compile_trace compile_trace;
+        carto::compile_trace *trace = vm.count("trace") ? &compile_trace : 0;
         
         if (boost::algorithm::ends_with(input_file,".mml"))
         {
+            carto::intermediate::selectivity_type selectivity;
+            carto::intermediate::rule_hits_type rule_hits;
+            std::vector<carto::feature_sample> samples;
+            double evaluations_before = 0;
+            
+            if (sample_limit || profile_limit) {
+                // compile once to learn which conditions and rules each
+                // style has, then look at the data
+                mapnik::Map sample_map(800,600);
+                carto::intermediate::conditions_type conditions;
+                carto::intermediate::rule_names_type rule_names;
+                
+                carto::mml_parser sampler = carto::load_mml(input_file, false);
+                configure(sampler, vm);
+                sampler.conditions = &conditions;
+                sampler.rule_names = &rule_names;
+                sampler.parse_map(sample_map);
+                
+                if (sample_limit)
+                    selectivity = carto::sample_selectivity(sample_map, conditions, sample_limit, &std::clog);
+                
+                if (profile_limit) {
+                    samples = carto::sample_layers(sample_map, profile_limit, &std::clog);
+                    rule_hits = carto::count_rule_matches(sample_map, rule_names, samples);
+                    evaluations_before = carto::filter_evaluations(sample_map, samples);
+                }
+            }
+            
+            carto::intermediate::symbolizer_counts_type symbolizers;
+            
+            carto::stat_timer parse_timer(stats, "mml parse");
+            carto::trace_scope parse_trace(trace, "parse", input_file);
             carto::mml_parser parser = carto::load_mml(input_file, false);
+            parse_timer.stop();
+            parse_trace.stop();
+            
+            configure(parser, vm);
+            parser.stats = stats;
+            parser.trace = trace;
+            if (sample_limit)
+                parser.selectivity = &selectivity;
+            if (profile_limit)
+                parser.rule_hits = &rule_hits;
+            if (vm.count("share-styles"))
+                parser.symbolizers = &symbolizers;
+            
+            if (!variant_files.empty()) {
+                // every variant and the map itself compile from the same
+                // parsed stylesheets
+                parser.load_stylesheets();
+                
+                for (std::size_t i = 0; i < variant_files.size(); ++i)
+                    variants.push_back(carto::load_variant(variant_files[i], false));
+                
+                variant_maps.assign(variants.size(), mapnik::Map(800,600));
+                variant_errors = carto::compile_variants(parser, variants, variant_maps, jobs);
+                for (std::size_t i = 0; i < variant_errors.size(); ++i) {
+                    if (!variant_errors[i].empty())
+                        std::clog << "### WARNING: " << variant_errors[i] << "\n";
+                }
+            }
+            
             parser.parse_map(m);
+            
+            report_symbolizers(symbolizers);
+            for (std::size_t i = 0; i < parser.shared_styles.size(); ++i)
+                std::clog << "### NOTE: style " << parser.shared_styles[i].first
+                          << " replaced by identical " << parser.shared_styles[i].second << "\n";
+            
+            if (profile_limit)
+                std::clog << "### NOTE: moved " << parser.reordered_rules << " rules, "
+                          << "filter evaluations per feature and zoom level: "
+                          << evaluations_before << " before, "
+                          << carto::filter_evaluations(m, samples) << " after\n";
+            
+            for (std::size_t i = 0; i < parser.pruned_rules.size(); ++i)
+                std::clog << "### NOTE: pruned " << parser.pruned_rules[i].get_string() << "\n";
+            if (parser.merged_rules)
+                std::clog << "### NOTE: merged " << parser.merged_rules << " rules into adjacent zoom ranges\n";
+            if (parser.folded_rules)
+                std::clog << "### NOTE: folded " << parser.folded_rules << " rules into value disjunctions\n";
+            
+            if (parser.datasources->shared())
+                std::clog << "### NOTE: " << m.layer_count() << " layers share "
+                          << parser.datasources->size() << " datasources ("
+                          << parser.datasources->shared() << " reused)\n";
+            
+            if (validate_jobs) {
+                std::vector<std::string> errors = carto::validate_datasources(m, validate_jobs);
+                for (std::size_t i = 0; i < errors.size(); ++i)
+                    std::clog << "### WARNING: " << errors[i] << "\n";
+            }
         }
         else if (boost::algorithm::ends_with(input_file,".mss")) 
         {
+            carto::stat_timer parse_timer(stats, "mss parse");
+            carto::trace_scope parse_trace(trace, "parse", input_file);
             carto::mss_parser parser = carto::load_mss(input_file, false);
+            parse_timer.stop();
+            parse_trace.stop();
+            
             carto::style_env env;
+            parser.stats = stats;
+            parser.trace = trace;
+            parser.prune_rules = vm.count("prune-rules");
+            parser.merge_zooms = vm.count("merge-zooms");
+            parser.fold_values = vm.count("fold-values");
+            if (vm.count("dump"))
+                parser.dump = &std::clog;
+            if (vm.count("order-filters"))
+                parser.filter_order = carto::intermediate::order_by_cost;
+            
+            carto::intermediate::symbolizer_counts_type symbolizers;
+            if (vm.count("share-styles"))
+                parser.symbolizers = &symbolizers;
             parser.parse_stylesheet(m, env);
+            
+            report_symbolizers(symbolizers);
+            
+            for (std::size_t i = 0; i < parser.pruned.size(); ++i)
+                std::clog << "### NOTE: pruned " << parser.pruned[i].get_string() << "\n";
+            if (parser.merged_rules)
+                std::clog << "### NOTE: merged " << parser.merged_rules << " rules into adjacent zoom ranges\n";
+            if (parser.folded_rules)
+                std::clog << "### NOTE: folded " << parser.folded_rules << " rules into value disjunctions\n";
         }
         
+        carto::stat_timer save_timer(stats, "save");
+        carto::trace_scope save_trace(trace, "save", vm.count("out") ? output_file : "stdout");
         std::string output = mapnik::save_map_to_string(m,false);
+        save_timer.stop();
+        save_trace.stop();
         
+        if (vm.count("stats")) {
+            if (stats_format == "json")
+                stats->write_json(std::clog);
+            else
+                stats->write_text(std::clog);
+        }
+
+        if (trace) {
+            std::ofstream file(trace_file.c_str());
+            if (!file.is_open()) {
+                std::cout << "Error: could not save trace to: " << trace_file << "\n";
+                return EXIT_FAILURE;
+            }
+            trace->write_json(file);
+        }
+
         if (!vm.count("out")) {
             std::cout << output << std::endl;
         } else {
@@ -109,9 +473,34 @@ int main(int argc, char **argv) {
             }
             file << output;
             file.close();
+            if (!file) {
+                std::cout << "Error: could not write xml to: " << output_file << "\n";
+                return EXIT_FAILURE;
+            }
         }
-            
-           
+        
+        if (vm.count("split-zooms")) {
+            for (std::size_t i = 0; i < bands.size(); ++i) {
+                if (!save_map(carto::specialize_map(m, bands[i]),
+                              output_name(output_file, "z" + bands[i].get_string())))
+                    return EXIT_FAILURE;
+            }
+        }
+        
+        // the variants that compiled are still written when others didn't
+        bool variant_failed = false;
+        for (std::size_t i = 0; i < variants.size(); ++i) {
+            if (!variant_errors[i].empty())
+                variant_failed = true;
+            else if (!save_map(variant_maps[i], output_name(output_file, variants[i].name)))
+                return EXIT_FAILURE;
+        }
+        
+        if (carto::alloc_tracking_enabled())
+            carto::write_alloc_stats(std::clog);
+        
+        if (variant_failed)
+            return EXIT_FAILURE;
     } catch (std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
     } catch(...) {
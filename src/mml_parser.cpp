@@ -9,7 +9,13 @@
 #include <mss_parser.hpp>
 
 #include <iosfwd>
+#include <iostream>
 #include <sstream>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <cctype>
 
 #include <mapnik/map.hpp>
 #include <mapnik/layer.hpp>
@@ -20,10 +26,13 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 
 #include <mss_parser.hpp>
-#include <parse/parse_tree.hpp>
-#include <parse/json_grammar.hpp>
+#include <datasource_pool.hpp>
+#include <style_index.hpp>
+#include <utility/thread_pool.hpp>
+#include <parse/mml_reader.hpp>
 #include <utility/utree.hpp>
 
 namespace carto {
@@ -31,189 +40,248 @@ namespace carto {
 using mapnik::config_error;
 namespace al = boost::algorithm;
   
-mml_parser::mml_parser(parse_tree const& pt, bool strict_, std::string const& path_)
-  : tree(pt),
+mml_parser::mml_parser(mml_document const& doc, bool strict_, std::string const& path_)
+  : document(doc),
     strict(strict_),
-    path(path_) { }
+    path(path_),
+    lazy_datasources(false),
+    datasources(new datasource_pool()),
+    infer_zooms(false),
+    prune_rules(false),
+    merge_zooms(false),
+    merged_rules(0),
+    fold_values(false),
+    folded_rules(0),
+    filter_order(intermediate::order_by_key),
+    selectivity(0),
+    conditions(0),
+    rule_names(0),
+    rule_hits(0),
+    reordered_rules(0),
+    symbolizers(0),
+    share_styles(false),
+    project_columns(false),
+    variant(0),
+    sources(0),
+    cache(0),
+    log(&std::clog),
+    dump(0),
+    stats(0),
+    trace(0) { }
   
 mml_parser::mml_parser(std::string const& in, bool strict_, std::string const& path_)
-  : strict(strict_),
-    path(path_) 
-{ 
-    typedef position_iterator<std::string::const_iterator> it_type;
-    tree = build_parse_tree< json_parser<it_type> >(in, path);    
-}
-
-parse_tree mml_parser::get_parse_tree()
-{
-    return tree;
-}
+  : document(read_mml(in, path_)),
+    strict(strict_),
+    path(path_),
+    lazy_datasources(false),
+    datasources(new datasource_pool()),
+    infer_zooms(false),
+    prune_rules(false),
+    merge_zooms(false),
+    merged_rules(0),
+    fold_values(false),
+    folded_rules(0),
+    filter_order(intermediate::order_by_key),
+    selectivity(0),
+    conditions(0),
+    rule_names(0),
+    rule_hits(0),
+    reordered_rules(0),
+    symbolizers(0),
+    share_styles(false),
+    project_columns(false),
+    variant(0),
+    sources(0),
+    cache(0),
+    log(&std::clog),
+    dump(0),
+    stats(0),
+    trace(0) { }
 
 std::string mml_parser::get_path()
 {
     return path;
 }
 
-node_type mml_parser::get_node_type(utree const& ut)
-{   
-    return( (node_type) tree.annotations(ut.tag()).second );
-}
-
-source_location mml_parser::get_location(utree const& ut)
-{    
-    return tree.annotations()[ut.tag()].first;
-}
-
-void mml_parser::key_error(std::string const& key, utree const& node) {
+void mml_parser::key_error(mml_member const& member) {
+    
+    source_location loc = member.location;
     
     std::stringstream err;
-    err << "Unknown keyword: " << key
-        << " at " << get_location(node).get_string(); 
+    err << "Unknown keyword: " << member.key
+        << " at " << loc.get_string(); 
     
     if (strict)
         throw config_error(err.str());
-    else
-        std::clog << "### WARNING: " << err.str() << "\n";    
+    else if (log)
+        *log << "### WARNING: " << err.str() << "\n";
 }
 
 void mml_parser::parse_map(mapnik::Map& map)
 {
-    //using spirit::utree_type;
-    typedef utree::const_iterator iter;
-    
-    
-    utree const& root_node = tree.ast();
-    
-    BOOST_ASSERT(get_node_type(root_node) == json_object);
+    typedef std::vector<mml_part>::const_iterator iter;
     
-    iter it = root_node.front().begin(),
-        end = root_node.front().end();
+    iter it  = document.parts.begin(),
+         end = document.parts.end();
     
+    // in document order: a Map { srs: ... } overrides the srs before its
+    // stylesheet, and is overridden by one after it
     for (; it != end; ++it) {
-        BOOST_ASSERT((*it).size()==2);
-    
-        std::string key = as<std::string>((*it).front());
-        utree const& value = (*it).back();  
-    
-        if (key == "srs") {
-            map.set_srs( as<std::string>(value) );
-        } else if (key == "Stylesheet") {
-            BOOST_ASSERT(get_node_type(value) == json_array);
-            parse_stylesheet(map, value);
-        } else if (key == "Layer") {
-            BOOST_ASSERT(get_node_type(value) == json_array);
-        
-            iter lyr_it  = value.begin(), 
-                 lyr_end = value.end();
-        
-            for (; lyr_it != lyr_end; ++lyr_it) {
-                BOOST_ASSERT(get_node_type(*lyr_it) == json_object);
-                parse_layer(map, (*lyr_it).front()) ;
-            }
+        if (it->type == mml_part::stylesheet) {
+            parse_stylesheet(map, it->begin, it->end);
+        } else if (it->type == mml_part::layer) {
+            for (std::size_t i = it->begin; i < it->end; ++i)
+                parse_layer(map, document.layers[i]);
         } else {
-            key_error(key, *it);
+            for (std::size_t i = it->begin; i < it->end; ++i) {
+                mml_member const& member = document.members[i];
+                if (member.key == "srs")
+                    map.set_srs( as<std::string>(member.value) );
+                else
+                    key_error(member);
+            }
         }        
     }
     
-    typedef std::pair< std::string, std::vector<std::string> > style_pair;
-    std::vector<style_pair> style_selectors;
+    stat_timer match_timer(stats, "style matching");
+    
+    style_index index;
     
     mapnik::Map::const_style_iterator s_it  =  map.begin_styles(),
                                       s_end =  map.end_styles();
     
     for(; s_it!=s_end; ++s_it) {
-        std::string name = (*s_it).first;
+        index.add_style((*s_it).first);
+    }
+    
+    for(size_t i=0; i < layer_selectors.size(); ++i) {
+        style_index::postings_type styles = index.match(layer_selectors[i]);
         
-        // remove attachment from style name
-        size_t loc = name.find("::");
-        if (loc != std::string::npos) {
-            al::erase_tail(name, name.length()-loc);
+        for(style_index::postings_type::const_iterator st_it = styles.begin();
+            st_it != styles.end();
+            ++st_it) {
+            map.getLayer(i).add_style(index.style_name(*st_it));
         }
-        
-        al::trim_if(name,al::is_any_of(". "));
-        std::vector<std::string> selectors;
-        al::split(selectors, name, al::is_any_of(". "));
-        
-        style_selectors.push_back(style_pair((*s_it).first,selectors));
     }
     
-    typedef std::vector< std::vector<std::string> >::const_iterator layer_it_type;
-    layer_it_type layer_it  = layer_selectors.begin(),
-                  layer_end = layer_selectors.end();
+    match_timer.stop();
+    
+    if (share_styles)
+        share_duplicate_styles(map);
+    
+    if (project_columns)
+        project_layer_columns(map);
+    
+    stat_timer datasource_timer(stats, "datasources");
+    for(size_t i=0; i < layer_datasources.size(); ++i) {
+        if (layer_datasources[i].defined)
+            create_datasource(map.getLayer(i), layer_datasources[i]);
+    }
+    datasource_timer.stop();
     
-    for(size_t i=0; layer_it != layer_end; ++layer_it, ++i) {
+    if (infer_zooms)
+        infer_layer_zooms(map);
+}
+
+void mml_parser::parse_stylesheet(mapnik::Map& map, std::size_t begin, std::size_t end)
+{
+    style_env env;
+    for (std::size_t i = begin; i < end; ++i) {
+        mss_parser parser = i < stylesheets.size() ? stylesheets[i]
+                                                   : load_stylesheet(document.stylesheets[i]);
         
-        typedef std::vector<style_pair>::const_iterator style_it_type;
-        style_it_type style_it  = style_selectors.begin(),
-                      style_end = style_selectors.end();
+        parser.prune_rules = prune_rules;
+        parser.merge_zooms = merge_zooms;
+        parser.fold_values = fold_values;
+        parser.filter_order = filter_order;
+        parser.selectivity = selectivity;
+        parser.conditions = conditions;
+        parser.rule_names = rule_names;
+        parser.rule_hits = rule_hits;
+        parser.symbolizers = symbolizers;
+        parser.sign_styles = share_styles;
+        parser.collect_attributes = project_columns;
+        parser.variant = variant;
+        parser.log = log;
+        parser.dump = dump;
+        parser.stats = stats;
+        parser.trace = trace;
+        parser.parse_stylesheet(map, env);
         
-        for(; style_it != style_end; ++style_it) {
-            typedef std::vector<std::string>::const_iterator selector_it_type;
+        pruned_rules.insert(pruned_rules.end(), parser.pruned.begin(), parser.pruned.end());
+        merged_rules += parser.merged_rules;
+        folded_rules += parser.folded_rules;
+        reordered_rules += parser.reordered_rules;
         
-            selector_it_type lselect_it  = (*layer_it).begin(),
-                             lselect_end = (*layer_it).end(),
-                             sselect_it  = (*style_it).second.begin(),
-                             sselect_end = (*style_it).second.end();
-            
-            for(; lselect_it != lselect_end; ++lselect_it) {
-                while(sselect_it != sselect_end && *lselect_it != *sselect_it) {
-                    ++sselect_it;
-                }
-                
-                if (sselect_it == sselect_end) break;
-            }
-            
-            if (lselect_it == lselect_end && sselect_it != sselect_end)
-                map.getLayer(i).add_style((*style_it).first);
+        typedef intermediate::style_signatures_type::const_iterator sig_iter;
+        for (sig_iter s_it = parser.signatures.begin(); s_it != parser.signatures.end(); ++s_it) {
+            // a style several stylesheets add to isn't described by any
+            if (style_signatures.count(s_it->first))
+                style_signatures[s_it->first].clear();
+            else
+                style_signatures[s_it->first] = s_it->second;
         }
+        
+        typedef intermediate::attribute_collector::styles_type::const_iterator attr_iter;
+        for (attr_iter a_it = parser.attributes.begin(); a_it != parser.attributes.end(); ++a_it)
+            style_attributes[a_it->first].insert(a_it->second.begin(), a_it->second.end());
     }
 }
 
-void mml_parser::parse_stylesheet(mapnik::Map& map, utree const& node)
+void mml_parser::load_stylesheets()
+{
+    stylesheets.clear();
+    
+    for (std::size_t i = 0; i < document.stylesheets.size(); ++i)
+        stylesheets.push_back(load_stylesheet(document.stylesheets[i]));
+}
+
+mss_parser mml_parser::load_stylesheet(std::string const& data)
 {
     namespace fs = boost::filesystem;
     
-    typedef utree::const_iterator iter;
+    stat_timer timer(stats, "mss parse");
     
-    iter it  = node.begin(), 
-         end = node.end();
+    if (sources) {
+        std::map<std::string, std::string>::const_iterator it = sources->find(data);
+        if (it != sources->end()) {
+            trace_scope scope(trace, "parse", data);
+            return cache ? mss_parser(cache->mss(it->second, data), strict, data)
+                         : mss_parser(it->second, strict, data);
+        }
+    }
     
     fs::path parent_dir = fs::path(path).parent_path();
+    fs::path abs_path( data ),
+        rel_path = parent_dir / abs_path;
     
-    style_env env;
-    for (; it != end; ++it) {
-        std::string data( as<std::string>(*it) );
-        fs::path abs_path( data ),
-            rel_path = parent_dir / abs_path;
-        
-        if (fs::exists(abs_path)) {
-            mss_parser parser = load_mss(abs_path.string(), strict);
-            parser.parse_stylesheet(map, env);
-        } else if (fs::exists(rel_path)) {
-            mss_parser parser = load_mss(rel_path.string(), strict);
-            parser.parse_stylesheet(map, env);
-        } else {
-            mss_parser parser(data, strict, path);
-            parser.parse_stylesheet(map, env);
-        }
-    }
+    std::string file = fs::exists(abs_path) ? abs_path.string() :
+                       fs::exists(rel_path) ? rel_path.string() : "";
+    
+    trace_scope scope(trace, "parse", file.empty() ? path : file);
+    
+    if (!cache)
+        return file.empty() ? mss_parser(data, strict, path) : load_mss(file, strict);
+    
+    return file.empty() ? mss_parser(cache->mss(data, path), strict, path)
+                        : mss_parser(cache->mss(read_source(file), file), strict, file);
 }
 
-void mml_parser::parse_layer(mapnik::Map& map, utree const& node)
+void mml_parser::parse_layer(mapnik::Map& map, mml_layer const& layer)
 {
     mapnik::layer lyr("");
     
     std::string lyr_name, lyr_id, lyr_class;
+    std::pair<bool, bool> zooms_given(false, false);
+    datasource_def ds_def;
     
-    typedef utree::const_iterator iter;
-    iter it  = node.begin(), 
-         end = node.end();
+    typedef std::vector<mml_member>::const_iterator iter;
+    iter it  = layer.members.begin(), 
+         end = layer.members.end();
     
     for (; it != end; ++it) {
-        BOOST_ASSERT((*it).size()==2);
-    
-        std::string key = as<std::string>((*it).front());
-        utree const& value = (*it).back();
+        std::string const& key = it->key;
+        utree const& value = it->value;
     
         if (key == "id") {
             lyr_id = "#"+as<std::string>(value);
@@ -229,19 +297,26 @@ void mml_parser::parse_layer(mapnik::Map& map, utree const& node)
             lyr.setActive( as<bool>(value) );
         } else if (key == "minzoom") {
             lyr.setMinZoom( value.get<double>() );
+            zooms_given.first = true;
         } else if (key == "maxzoom") {
             lyr.setMaxZoom( value.get<double>() );
+            zooms_given.second = true;
         } else if (key == "queryable") {
             lyr.setQueryable( value.get<bool>() );
-        } else if (key == "Datasource") {
-            BOOST_ASSERT(get_node_type(value) == json_object);
-            parse_Datasource(lyr, value.front());
         } else {
-            key_error(key, *it);
+            key_error(*it);
         }
     }
     
+    if (layer.has_datasource) {
+        ds_def.defined = true;
+        ds_def.location = layer.datasource_location;
+        parse_Datasource(ds_def.params, layer.datasource);
+    }
+    
     map.addLayer(lyr);
+    layer_zooms_given.push_back(zooms_given);
+    layer_datasources.push_back(ds_def);
     
     layer_selectors.push_back( std::vector<std::string>() );
     int i = layer_selectors.size()-1;
@@ -250,28 +325,23 @@ void mml_parser::parse_layer(mapnik::Map& map, utree const& node)
     
     if (!lyr_id.empty())
         layer_selectors[i].push_back(lyr_id);
-    if (!lyr_class.empty())
-        al::split(layer_selectors[i], lyr_class, al::is_any_of(". "), al::token_compress_on);
+    if (!lyr_class.empty()) {
+        // split replaces what it splits into, and the id is already there
+        std::vector<std::string> classes;
+        al::split(classes, lyr_class, al::is_any_of(". "), al::token_compress_on);
+        layer_selectors[i].insert(layer_selectors[i].end(), classes.begin(), classes.end());
+    }
 }
 
 
-void mml_parser::parse_Datasource(mapnik::layer& lyr, utree const& node)
+void mml_parser::parse_Datasource(mapnik::parameters& params, std::vector<mml_member> const& members)
 {
-    mapnik::parameters params;
-    
-    typedef utree::const_iterator iter;
-    iter it  = node.begin(), 
-         end = node.end();
+    typedef std::vector<mml_member>::const_iterator iter;
+    iter it  = members.begin(), 
+         end = members.end();
     
     for (; it != end; ++it)
-    {
-        BOOST_ASSERT((*it).size()==2);
-
-        std::string name  = as<std::string>((*it).front());
-        std::string value = as<std::string>((*it).back());
-        
-        params[name] = value;
-    }
+        params[it->key] = as<std::string>(it->value);
 
     boost::optional<std::string> base_param = params.get<std::string>("base");
     boost::optional<std::string> file_param = params.get<std::string>("file");
@@ -281,20 +351,206 @@ void mml_parser::parse_Datasource(mapnik::layer& lyr, utree const& node)
     } else if (file_param) {
         params["file"] = ensure_relative_to_xml(file_param);
     }
+}
+
+void mml_parser::create_datasource(mapnik::layer& lyr, datasource_def const& def)
+{
+    trace_scope scope(trace, "datasource", lyr.name());
     
     try {
-        boost::shared_ptr<mapnik::datasource> ds = mapnik::datasource_cache::instance()->create(params,false);
+        boost::shared_ptr<mapnik::datasource> ds = datasources->get(def.params, lazy_datasources);
         lyr.set_datasource(ds);
     } catch (std::exception& e) {
+        source_location loc = def.location;
         
         std::stringstream err;
         err << "Datasource creation issue ("
-            << e.what() << ") at " << get_location(node).get_string(); 
+            << e.what() << ") at " << loc.get_string(); 
 
         if (strict)
             throw config_error(err.str());
+        else if (log)
+            *log << "### WARNING: " << err.str() << "\n";
+    }
+}
+
+static bool is_table_name(std::string const& table)
+{
+    if (table.empty()) return false;
+    
+    for (std::string::const_iterator it = table.begin(); it != table.end(); ++it) {
+        if (!std::isalnum(static_cast<unsigned char>(*it)) && *it != '_' && *it != '.' && *it != '"')
+            return false;
+    }
+    return true;
+}
+
+static std::string quote_identifier(std::string const& name)
+{
+    return "\"" + al::replace_all_copy(name, "\"", "\"\"") + "\"";
+}
+
+// the columns of the table params names, as its datasource describes them
+static std::set<std::string> table_columns(mapnik::parameters const& params)
+{
+    std::set<std::string> columns;
+    
+    mapnik::datasource_ptr ds = mapnik::datasource_cache::instance()->create(params, true);
+    std::vector<mapnik::attribute_descriptor> const& descriptors = ds->get_descriptor().get_descriptors();
+    for (std::vector<mapnik::attribute_descriptor>::const_iterator it = descriptors.begin();
+         it != descriptors.end();
+         ++it)
+        columns.insert(it->get_name());
+    
+    return columns;
+}
+
+void mml_parser::share_duplicate_styles(mapnik::Map& map)
+{
+    typedef std::map<std::string, std::string> names_type;
+    
+    names_type canonical,   // signature -> style kept
+               replaced;    // style -> style kept
+    
+    typedef intermediate::style_signatures_type::const_iterator sig_iter;
+    for (sig_iter it = style_signatures.begin(); it != style_signatures.end(); ++it) {
+        if (it->second.empty()) continue;
+        
+        names_type::const_iterator c_it = canonical.find(it->second);
+        if (c_it == canonical.end())
+            canonical[it->second] = it->first;
         else
-            std::clog << "### WARNING: " << err.str() << "\n";
+            replaced[it->first] = c_it->second;
+    }
+    
+    if (replaced.empty()) return;
+    
+    for (size_t i = 0; i < map.layer_count(); ++i) {
+        std::vector<std::string>& styles = map.getLayer(i).styles();
+        for (std::vector<std::string>::iterator st_it = styles.begin(); st_it != styles.end(); ++st_it) {
+            names_type::const_iterator r_it = replaced.find(*st_it);
+            if (r_it != replaced.end())
+                *st_it = r_it->second;
+        }
+    }
+    
+    for (names_type::const_iterator it = replaced.begin(); it != replaced.end(); ++it) {
+        map.remove_style(it->first);
+        shared_styles.push_back(*it);
+    }
+}
+
+void mml_parser::project_layer_columns(mapnik::Map const& map)
+{
+    typedef intermediate::attribute_collector::attribute_set attribute_set;
+    
+    // layers on the same table describe it once
+    std::map<std::string, attribute_set> described;
+    
+    for (size_t i = 0; i < layer_datasources.size(); ++i) {
+        mapnik::parameters& params = layer_datasources[i].params;
+        if (!layer_datasources[i].defined) continue;
+        
+        boost::optional<std::string> type  = params.get<std::string>("type"),
+                                     table = params.get<std::string>("table"),
+                                     geom  = params.get<std::string>("geometry_field"),
+                                     key   = params.get<std::string>("key_field");
+        
+        // only plain table names can be narrowed to a subquery; without an
+        // explicit geometry column we can't name it in the select list.
+        // file based plugins already read only the attributes the renderer
+        // asks for, so there is nothing to gain there
+        if (!type || (*type != "postgis" && *type != "sqlite") ||
+            !table || !is_table_name(*table) || !geom || geom->empty())
+            continue;
+        
+        attribute_set attrs;
+        std::vector<std::string> const& styles = map.getLayer(i).styles();
+        for (std::vector<std::string>::const_iterator st_it = styles.begin();
+             st_it != styles.end();
+             ++st_it) {
+            intermediate::attribute_collector::styles_type::const_iterator a_it = style_attributes.find(*st_it);
+            if (a_it != style_attributes.end())
+                attrs.insert(a_it->second.begin(), a_it->second.end());
+        }
+        
+        // styles may read fields a table doesn't have, which mapnik
+        // tolerates but a select list doesn't, so only columns the
+        // datasource describes are kept; that takes a bind, once per table
+        std::string table_key = datasource_pool::key(params);
+        std::map<std::string, attribute_set>::const_iterator d_it = described.find(table_key);
+        if (d_it == described.end()) {
+            try {
+                d_it = described.insert(std::make_pair(table_key, table_columns(params))).first;
+            } catch (std::exception& e) {
+                if (log)
+                    *log << "### WARNING: columns of layer " << map.getLayer(i).name()
+                         << " not projected (" << e.what() << ")\n";
+                continue;
+            }
+        }
+        
+        attribute_set columns;
+        std::set_intersection(attrs.begin(), attrs.end(),
+                              d_it->second.begin(), d_it->second.end(),
+                              std::inserter(columns, columns.begin()));
+        
+        columns.erase(*geom);
+        if (key && !key->empty())
+            columns.insert(*key);
+        
+        std::string alias = table->substr(table->find_last_of('.') + 1);
+        al::erase_all(alias, "\"");
+        
+        std::stringstream sql;
+        sql << "(select " << quote_identifier(*geom);
+        for (attribute_set::const_iterator it = columns.begin(); it != columns.end(); ++it)
+            sql << ", " << quote_identifier(*it);
+        sql << " from " << *table << ") as " << quote_identifier(alias);
+        
+        params["table"] = sql.str();
+    }
+}
+
+void mml_parser::infer_layer_zooms(mapnik::Map& map)
+{
+    // a layer is only worth querying at scales where at least one rule of
+    // one of its styles is active, i.e. within the union of the rule scale
+    // ranges (rules default to [0, inf) so an unbounded rule keeps the
+    // layer unbounded too)
+    for (size_t i = 0; i < map.layer_count(); ++i) {
+        mapnik::layer& lyr = map.getLayer(i);
+        
+        if (layer_zooms_given[i].first && layer_zooms_given[i].second)
+            continue;
+        
+        double min_scale = std::numeric_limits<double>::infinity(),
+               max_scale = 0;
+        bool any_rule = false;
+        
+        std::vector<std::string> const& styles = lyr.styles();
+        for (std::vector<std::string>::const_iterator st_it = styles.begin();
+             st_it != styles.end();
+             ++st_it) {
+            boost::optional<mapnik::feature_type_style const&> style = map.find_style(*st_it);
+            if (!style) continue;
+            
+            mapnik::feature_type_style::rules const& rules = style->get_rules();
+            for (mapnik::feature_type_style::rules::const_iterator r_it = rules.begin();
+                 r_it != rules.end();
+                 ++r_it) {
+                min_scale = std::min(min_scale, r_it->get_min_scale());
+                max_scale = std::max(max_scale, r_it->get_max_scale());
+                any_rule = true;
+            }
+        }
+        
+        if (!any_rule) continue;
+        
+        if (!layer_zooms_given[i].first && min_scale > 0)
+            lyr.setMinZoom(min_scale);
+        if (!layer_zooms_given[i].second && max_scale < std::numeric_limits<double>::max())
+            lyr.setMaxZoom(max_scale);
     }
 }
 
@@ -332,12 +588,60 @@ mml_parser load_mml(std::string filename, bool strict)
     return mml_parser(in, strict, filename);
 }
 
-/*
+static void compile_variant(mml_parser const& base, style_variant const& variant,
+                            mapnik::Map& map, std::string& error)
+{
+    try {
+        mml_parser parser(base);
+        parser.variant = &variant;
+        
+        // these would be written to by every variant at once
+        parser.conditions = 0;
+        parser.rule_names = 0;
+        parser.symbolizers = 0;
+        parser.dump = 0;
+        parser.stats = 0;
+        
+        trace_scope scope(parser.trace, "variant", variant.name);
+        parser.parse_map(map);
+    } catch (std::exception& e) {
+        error = "Variant " + variant.name + ": " + e.what();
+    }
+}
+
+std::vector<std::string> compile_variants(mml_parser const& base,
+                                          std::vector<style_variant> const& variants,
+                                          std::vector<mapnik::Map>& maps,
+                                          unsigned jobs)
+{
+    BOOST_ASSERT(maps.size() == variants.size());
+    
+    mml_parser parsed(base);
+    if (parsed.stylesheets.empty())
+        parsed.load_stylesheets();
+    
+    std::vector<std::string> errors(variants.size());
+    
+    if (jobs != 1 && variants.size() > 1) {
+        thread_pool pool(jobs ? std::min<std::size_t>(jobs, variants.size()) : 0);
+        
+        // every task writes only to its own map and error
+        for (std::size_t i = 0; i < variants.size(); ++i)
+            pool.submit(boost::bind(&compile_variant, boost::cref(parsed), boost::cref(variants[i]),
+                                    boost::ref(maps[i]), boost::ref(errors[i])));
+        pool.wait();
+    } else {
+        for (std::size_t i = 0; i < variants.size(); ++i)
+            compile_variant(parsed, variants[i], maps[i], errors[i]);
+    }
+    
+    return errors;
+}
+
 mml_parser load_mml_string(std::string const& in, bool strict, std::string const& base_url)
 {
     return mml_parser(in, strict, base_url);
 }
-*/
 
 }
 
@@ -8,6 +8,7 @@
 #include <mss_parser.hpp>
 
 #include <iosfwd>
+#include <iostream>
 #include <fstream>
 #include <sstream>
 
@@ -42,24 +43,95 @@
 #include <utility/round.hpp>
 
 #include <intermediate/dumper.hpp>
+#include <intermediate/attribute_collector.hpp>
+#include <intermediate/rule_pruner.hpp>
 
 namespace carto {
 
 using mapnik::config_error;
 
 mss_parser::mss_parser(parse_tree const& pt, bool strict_, std::string const& path_)
-  : intermediate_parser(carto::intermediate::mss_parser(pt, strict_, path_)) { }
+  : intermediate_parser(carto::intermediate::mss_parser(pt, strict_, path_)),
+    prune_rules(false),
+    merge_zooms(false),
+    merged_rules(0),
+    fold_values(false),
+    folded_rules(0),
+    filter_order(carto::intermediate::order_by_key),
+    selectivity(0),
+    conditions(0),
+    rule_names(0),
+    rule_hits(0),
+    reordered_rules(0),
+    symbolizers(0),
+    sign_styles(false),
+    collect_attributes(false),
+    variant(0),
+    log(&std::clog),
+    dump(0),
+    stats(0),
+    trace(0) { }
 
 mss_parser::mss_parser(std::string const& in, bool strict_, std::string const& path_)
-  : intermediate_parser(carto::intermediate::mss_parser(in, strict_, path_)) { }
+  : intermediate_parser(carto::intermediate::mss_parser(in, strict_, path_)),
+    prune_rules(false),
+    merge_zooms(false),
+    merged_rules(0),
+    fold_values(false),
+    folded_rules(0),
+    filter_order(carto::intermediate::order_by_key),
+    selectivity(0),
+    conditions(0),
+    rule_names(0),
+    rule_hits(0),
+    reordered_rules(0),
+    symbolizers(0),
+    sign_styles(false),
+    collect_attributes(false),
+    variant(0),
+    log(&std::clog),
+    dump(0),
+    stats(0),
+    trace(0) { }
 
 void mss_parser::parse_stylesheet(mapnik::Map& map, style_env& env)
 {
     carto::intermediate::stylesheet styl;
+    intermediate_parser.variant = variant;
+    intermediate_parser.stats = stats;
+    intermediate_parser.trace = trace;
     intermediate_parser.parse_stylesheet(styl, env);
 
-    carto::intermediate::dumper(std::clog).visit(styl);
-    carto::intermediate::mss_to_mapnik(map).visit(styl);
+    if (prune_rules) {
+        stat_timer timer(stats, "prune");
+        carto::intermediate::rule_pruner(pruned).prune(styl);
+    }
+
+    if (dump)
+        carto::intermediate::dumper(*dump).visit(styl);
+    
+    stat_timer generate_timer(stats, "generate");
+    trace_scope generate_trace(trace, "generate", intermediate_parser.path);
+    
+    carto::intermediate::mss_to_mapnik generator(map, merge_zooms);
+    generator.set_fold_values(fold_values);
+    generator.set_filter_order(filter_order, selectivity);
+    generator.record_conditions(conditions);
+    generator.record_rules(rule_names);
+    generator.set_rule_hits(rule_hits);
+    generator.record_symbolizers(symbolizers);
+    generator.record_signatures(sign_styles ? &signatures : 0);
+    generator.set_log(log);
+    generator.set_stats(stats);
+    generator.visit(styl);
+    merged_rules += generator.merged_rules();
+    folded_rules += generator.folded_rules();
+    reordered_rules += generator.reordered_rules();
+    generate_timer.stop();
+    generate_trace.stop();
+    
+    if (collect_attributes)
+        carto::intermediate::attribute_collector(attributes).visit(styl);
 }
 
 mss_parser load_mss(std::string filename, bool strict)
@@ -0,0 +1,360 @@
+#include <parse/mml_reader.hpp>
+#include <parse/skipper.hpp>
+#include <parse/string_grammar.hpp>
+
+#include <exception.hpp>
+#include <utility/utree.hpp>
+
+#include <mapnik/config_error.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace carto {
+
+using boost::spirit::utf8_symbol_type;
+
+static bool is_key_char(char c)
+{
+    // what json_parser's member rule excludes: space, control characters,
+    // brackets, colon and quote
+    switch (c) {
+        case '{': case '}': case '[': case ']': case ':': case '"': case '\x7f':
+            return false;
+        default:
+            return static_cast<unsigned char>(c) > ' ';
+    }
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// The rules of json_parser over the source characters, filling the parts
+// of an mml_document as they come by. Every rule leaves the position after
+// the space and comments that follow what it read, where the grammar's
+// annotator would be. Locations are counted only as far as one is needed.
+class mml_reader {
+public:
+    mml_reader(std::string const& in, std::string const& path)
+      : path_(path),
+        p_(in.data()),
+        end_(in.data() + in.size()),
+        counted_(in.data()),
+        loc_(1, 0),
+        prev_(0),
+        scratch_()
+    { }
+
+    void read(mml_document& doc)
+    {
+        skip();
+        if (!at('{')) fail("an object");
+        if (!open('}')) return;
+
+        // the grammar stops after the root object, whatever follows it
+        do {
+            span_type name = key();
+            mml_part part;
+            if (is(name, "Stylesheet")) {
+                part.type = mml_part::stylesheet;
+                part.begin = doc.stylesheets.size();
+                stylesheets(doc.stylesheets);
+                part.end = doc.stylesheets.size();
+            } else if (is(name, "Layer")) {
+                part.type = mml_part::layer;
+                part.begin = doc.layers.size();
+                layers(doc.layers);
+                part.end = doc.layers.size();
+            } else {
+                part.type = mml_part::member;
+                part.begin = doc.members.size();
+                member(name, doc.members);
+                part.end = doc.members.size();
+            }
+            doc.parts.push_back(part);
+        } while (more('}'));
+    }
+
+private:
+    typedef std::pair<char const*, char const*> span_type;
+
+    typedef qi::real_parser<double, qi::strict_real_policies<double> > real_type;
+
+    static bool is(span_type const& s, char const* word)
+    {
+        std::size_t n = std::strlen(word);
+        return static_cast<std::size_t>(s.second - s.first) == n && std::equal(s.first, s.second, word);
+    }
+
+    bool at(char c) const
+    {
+        return p_ != end_ && *p_ == c;
+    }
+
+    void skip()
+    {
+        // mostly there is nothing, or a single space, to skip
+        if (p_ != end_ && (*p_ == ' ' || (*p_ >= '\t' && *p_ <= '\r') || *p_ == '/'))
+            p_ = scan_space(p_, end_, true);
+    }
+
+    source_location location()
+    {
+        advance_location(loc_, prev_, counted_, p_);
+        counted_ = p_;
+        return loc_;
+    }
+
+    void fail(char const* what)
+    {
+        std::string got = p_ == end_
+                        ? "end of input"
+                        : "\"" + std::string(p_, std::min<std::ptrdiff_t>(end_ - p_, 20)) + "\"";
+        carto::exception e(path_, location(), std::string("(expected ") + what + ", got " + got + ")");
+        throw mapnik::config_error(e.what());
+    }
+
+    void expect(char c, char const* what)
+    {
+        if (!at(c)) fail(what);
+        ++p_;
+        skip();
+    }
+
+    // At the opening bracket of an object or array: true when there is a
+    // member or element to read, false after an empty one
+    bool open(char close)
+    {
+        ++p_;
+        skip();
+        if (!at(close)) return true;
+        ++p_;
+        skip();
+        return false;
+    }
+
+    // After a member or element: true past the comma before another one,
+    // false past the closing bracket
+    bool more(char close)
+    {
+        if (at(',')) {
+            ++p_;
+            skip();
+            return true;
+        }
+        expect(close, close == '}' ? "\",\" or \"}\"" : "\",\" or \"]\"");
+        return false;
+    }
+
+    // "name": up to the value. Names are never escaped, and the grammar
+    // skips space inside the quotes.
+    span_type key()
+    {
+        if (!at('"')) fail("a member name");
+        ++p_;
+        skip();
+
+        char const* begin = p_;
+        while (p_ != end_ && is_key_char(*p_)) ++p_;
+        if (p_ == begin) fail("a member name");
+        span_type name(begin, p_);
+
+        skip();
+        expect('"', "\"\\\"\"");
+        expect(':', "\":\"");
+        return name;
+    }
+
+    // The string at p_, unescaped: a view of the source when there is no
+    // escape in it, else of scratch_, good until the next string
+    span_type string()
+    {
+        char const* begin = ++p_;
+        char const* q = find_either(p_, end_, '"', '\\');
+        if (q != end_ && *q == '"') {
+            p_ = q + 1;
+            return span_type(begin, q);
+        }
+
+        scratch_.assign(begin, q);
+        for (p_ = q; !at('"'); p_ = q) {
+            if (p_ == end_) fail("\"\\\"\"");
+            escape();
+            q = find_either(p_, end_, '"', '\\');
+            scratch_.append(p_, q);
+        }
+        ++p_;
+        return span_type(scratch_.data(), scratch_.data() + scratch_.size());
+    }
+
+    // as utf8_string_parser decodes it, into scratch_
+    void escape()
+    {
+        char c = ++p_ != end_ ? *p_ : 0;
+        if (c == 'u' || c == 'U') {
+            uchar code_point = 0;
+            for (int digits = c == 'u' ? 4 : 8; digits; --digits) {
+                int digit = ++p_ != end_ ? hex_value(*p_) : -1;
+                if (digit < 0) fail("a hex digit");
+                code_point = code_point * 16 + digit;
+            }
+            push_utf8_functor()(scratch_, code_point);
+        } else if (c && std::strchr("btnfr\\\"'", c)) {
+            push_esc_functor()(scratch_, c);
+        } else {
+            fail("an escape");
+        }
+        ++p_;
+    }
+
+    // null | real | int_ | bool_, tried in the grammar's order with its
+    // own parsers, so numbers come out as they would from the tree
+    void scalar(utree* out)
+    {
+        char const* p = p_;
+        double real = 0;
+        int integer = 0;
+        bool boolean = false;
+
+        if (end_ - p >= 4 && std::equal(p, p + 4, "null")) {
+            p += 4;
+            if (out) *out = utree(utree::nil_type());
+        } else if (qi::parse(p, end_, real_type(), real)) {
+            if (out) *out = utree(real);
+        } else if (qi::parse(p, end_, qi::int_, integer)) {
+            if (out) *out = utree(integer);
+        } else if (qi::parse(p, end_, qi::bool_, boolean)) {
+            if (out) *out = utree(boolean);
+        } else {
+            fail("a value");
+        }
+
+        p_ = p;
+        skip();
+    }
+
+    // Any value, into out when given. Only the empty object and array are
+    // kept of values with members or elements, the rest are checked and
+    // left behind.
+    void value(utree* out)
+    {
+        if (at('"')) {
+            span_type s = string();
+            if (out) *out = utree(s.first, s.second - s.first);
+            skip();
+            return;
+        }
+
+        if (!at('{') && !at('[')) {
+            scalar(out);
+            return;
+        }
+
+        char close = *p_ == '{' ? '}' : ']';
+        if (!open(close)) {
+            if (out) *out = utree(utf8_symbol_type(close == '}' ? "{}" : "[]"));
+            return;
+        }
+
+        if (out) *out = utree(utree::list_type());
+        do {
+            if (close == '}') key();
+            value(0);
+        } while (more(close));
+    }
+
+    void member(span_type const& name, std::vector<mml_member>& members)
+    {
+        members.push_back(mml_member());
+        mml_member& m = members.back();
+        m.key.assign(name.first, name.second);
+        value(&m.value);
+        m.location = location();
+    }
+
+    void stylesheets(std::vector<std::string>& sheets)
+    {
+        if (!at('[')) fail("an array");
+        if (!open(']')) return;
+
+        do {
+            if (at('"')) {
+                span_type s = string();
+                sheets.push_back(std::string(s.first, s.second));
+                skip();
+            } else {
+                // as mml_parser converts it; as<std::string> of a utree
+                // that is not const is get<std::string>
+                utree entry;
+                value(&entry);
+                utree const& converted = entry;
+                sheets.push_back(detail::as<std::string>(converted));
+            }
+        } while (more(']'));
+    }
+
+    void layers(std::vector<mml_layer>& lyrs)
+    {
+        if (!at('[')) fail("an array");
+        if (!open(']')) return;
+
+        do {
+            if (!at('{')) fail("an object");
+            lyrs.push_back(mml_layer());
+            layer(lyrs.back());
+        } while (more(']'));
+    }
+
+    void layer(mml_layer& lyr)
+    {
+        if (!open('}')) return;
+
+        do {
+            span_type name = key();
+            if (is(name, "Datasource"))
+                datasource(lyr);
+            else
+                member(name, lyr.members);
+        } while (more('}'));
+    }
+
+    void datasource(mml_layer& lyr)
+    {
+        if (!at('{')) fail("an object");
+        lyr.has_datasource = true;
+
+        if (open('}')) {
+            do {
+                member(key(), lyr.datasource);
+            } while (more('}'));
+        }
+        lyr.datasource_location = location();
+    }
+
+    std::string const& path_;
+    char const* p_;
+    char const* end_;
+
+    // loc_ is counted up to counted_, prev_ is the character before it
+    char const* counted_;
+    source_location loc_;
+    char prev_;
+
+    std::string scratch_;
+};
+
+mml_document read_mml(std::string const& in, std::string const& path)
+{
+    mml_document doc;
+    mml_reader reader(in, path);
+    reader.read(doc);
+    return doc;
+}
+
+}
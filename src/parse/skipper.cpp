@@ -0,0 +1,202 @@
+#include <parse/skipper.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace carto {
+
+static bool is_space(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Byte masks over a block of the source: bit i is set when byte i of the
+// block is whitespace, or is one of two given bytes. 32 bytes at a time
+// with AVX2, 16 with SSE2 and a byte at a time without either.
+#if defined(__AVX2__)
+
+static std::size_t const block_size = 32;
+
+static unsigned space_mask(char const* p)
+{
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+    // \t \n \v \f \r are 9 to 13, so c - 9 is at most 4 for them, unsigned
+    __m256i control = _mm256_sub_epi8(c, _mm256_set1_epi8('\t'));
+    __m256i is_control = _mm256_cmpeq_epi8(_mm256_min_epu8(control, _mm256_set1_epi8(4)), control);
+    __m256i is_blank = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '));
+    return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(is_control, is_blank)));
+}
+
+static unsigned byte_mask(char const* p, char a, char b)
+{
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+    return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(a)),
+                                                                      _mm256_cmpeq_epi8(c, _mm256_set1_epi8(b)))));
+}
+
+#elif defined(__SSE2__)
+
+static std::size_t const block_size = 16;
+
+static unsigned space_mask(char const* p)
+{
+    __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    // \t \n \v \f \r are 9 to 13, so c - 9 is at most 4 for them, unsigned
+    __m128i control = _mm_sub_epi8(c, _mm_set1_epi8('\t'));
+    __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(4)), control);
+    __m128i is_blank = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(is_control, is_blank)));
+}
+
+static unsigned byte_mask(char const* p, char a, char b)
+{
+    __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(a)),
+                                                                _mm_cmpeq_epi8(c, _mm_set1_epi8(b)))));
+}
+
+#else
+
+static std::size_t const block_size = 1;
+
+static unsigned space_mask(char const* p)
+{
+    return is_space(*p);
+}
+
+static unsigned byte_mask(char const* p, char a, char b)
+{
+    return *p == a || *p == b;
+}
+
+#endif
+
+static unsigned const block_bits = ~0u >> (32 - block_size);
+
+static unsigned first_bit(unsigned mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    unsigned n = 0;
+    for (; !(mask & 1); mask >>= 1) ++n;
+    return n;
+#endif
+}
+
+static unsigned last_bit(unsigned mask)
+{
+#if defined(__GNUC__)
+    return 31 - __builtin_clz(mask);
+#else
+    unsigned n = 0;
+    for (; mask >>= 1; ) ++n;
+    return n;
+#endif
+}
+
+static unsigned bit_count(unsigned mask)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount(mask);
+#else
+    unsigned n = 0;
+    for (; mask; mask &= mask - 1) ++n;
+    return n;
+#endif
+}
+
+static char const* skip_blanks(char const* p, char const* end)
+{
+    for (; static_cast<std::size_t>(end - p) >= block_size; p += block_size) {
+        unsigned rest = ~space_mask(p) & block_bits;
+        if (rest) return p + first_bit(rest);
+    }
+    while (p != end && is_space(*p)) ++p;
+    return p;
+}
+
+char const* find_either(char const* p, char const* end, char a, char b)
+{
+    for (; static_cast<std::size_t>(end - p) >= block_size; p += block_size) {
+        unsigned found = byte_mask(p, a, b);
+        if (found) return p + first_bit(found);
+    }
+    while (p != end && *p != a && *p != b) ++p;
+    return p;
+}
+
+char const* scan_space(char const* p, char const* end, bool comments)
+{
+    while (true) {
+        // most runs between tokens are empty or a single space
+        if (p != end && is_space(*p))
+            p = skip_blanks(p + 1, end);
+
+        if (!comments || end - p < 2 || p[0] != '/')
+            return p;
+
+        if (p[1] == '/') {
+            p = find_either(p + 2, end, '\n', '\r');
+        } else if (p[1] == '*') {
+            char const* star = p + 2;
+            while (true) {
+                star = find_either(star, end, '*', '*');
+                if (end - star < 2) return p;
+                if (star[1] == '/') break;
+                ++star;
+            }
+            p = star + 2;
+        } else {
+            return p;
+        }
+    }
+}
+
+void advance_location(source_location& loc, char& prev, char const* p, char const* end)
+{
+    for (; static_cast<std::size_t>(end - p) >= block_size; p += block_size) {
+        unsigned n = byte_mask(p, '\n', '\n'), r = byte_mask(p, '\r', '\r'),
+                 tabs = byte_mask(p, '\t', '\t'), counted = block_bits;
+        if (n | r) {
+            // \r\n and \n\r are one line break
+            unsigned after_n = ((n << 1) | (prev == '\n')) & block_bits,
+                     after_r = ((r << 1) | (prev == '\r')) & block_bits;
+            loc.line += bit_count((n & ~after_r) | (r & ~after_n));
+            loc.column = 0;
+            counted &= ~((2u << last_bit(n | r)) - 1);
+        }
+        // a tab is two columns
+        loc.column += bit_count(counted) + bit_count(tabs & counted);
+        prev = p[block_size - 1];
+    }
+
+    for (; p != end; ++p) {
+        switch (*p) {
+            case '\r':
+                if (prev != '\n') {
+                    ++loc.line;
+                    loc.column = 0;
+                }
+                break;
+            case '\n':
+                if (prev != '\r') {
+                    ++loc.line;
+                    loc.column = 0;
+                }
+                break;
+            case '\t':
+                loc.column += 2;
+                break;
+            default:
+                ++loc.column;
+                break;
+        }
+        prev = *p;
+    }
+}
+
+}
@@ -0,0 +1,135 @@
+#include <parse_cache.hpp>
+
+#include <fstream>
+#include <iterator>
+
+#include <mapnik/config_error.hpp>
+
+#include <parse/carto_grammar.hpp>
+#include <parse/mml_reader.hpp>
+#include <position_iterator.hpp>
+
+namespace carto {
+
+using mapnik::config_error;
+
+typedef position_iterator<std::string::const_iterator> iter;
+
+parse_cache::parse_cache(std::size_t capacity)
+  : documents_(),
+    trees_(),
+    capacity_(capacity),
+    hits_(0),
+    misses_(0) { }
+
+// the path is part of the key, it ends up in error messages and the
+// trees' source locations
+static std::string cache_key(char kind, std::string const& in, std::string const& path)
+{
+    std::string key(1, kind);
+    key.reserve(in.size() + path.size() + 2);
+    key += path;
+    key += '\0';
+    key += in;
+    return key;
+}
+
+mml_document parse_cache::mml(std::string const& in, std::string const& path)
+{
+    std::string key = cache_key('j', in, path);
+    mml_document doc;
+
+    // parse outside the lock; two threads missing on the same source
+    // both parse it, which is harmless
+    if (!find(documents_, key, doc)) {
+        doc = read_mml(in, path);
+        insert(documents_, key, doc);
+    }
+
+    return doc;
+}
+
+parse_tree parse_cache::mss(std::string const& in, std::string const& path)
+{
+    std::string key = cache_key('c', in, path);
+    parse_tree tree;
+
+    if (!find(trees_, key, tree)) {
+        tree = build_parse_tree< carto_parser<iter> >(in, path);
+        insert(trees_, key, tree);
+    }
+
+    return tree;
+}
+
+template <typename Map>
+bool parse_cache::find(Map const& map, std::string const& key, typename Map::mapped_type& value)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+
+    typename Map::const_iterator it = map.find(key);
+    if (it == map.end()) {
+        ++misses_;
+        return false;
+    }
+
+    ++hits_;
+    value = it->second;
+    return true;
+}
+
+template <typename Map>
+void parse_cache::insert(Map& map, std::string const& key, typename Map::mapped_type const& value)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+
+    if (documents_.size() + trees_.size() >= capacity_) {
+        documents_.clear();
+        trees_.clear();
+    }
+
+    map[key] = value;
+}
+
+std::size_t parse_cache::size() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return documents_.size() + trees_.size();
+}
+
+std::size_t parse_cache::hits() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return hits_;
+}
+
+std::size_t parse_cache::misses() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return misses_;
+}
+
+void parse_cache::clear()
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    documents_.clear();
+    trees_.clear();
+}
+
+std::string read_source(std::string const& filename)
+{
+    std::ifstream file(filename.c_str(), std::ios_base::in);
+
+    if (!file)
+        throw config_error(std::string("Cannot open input file: ")+filename);
+
+    std::string in;
+    file.unsetf(std::ios::skipws);
+    copy(std::istream_iterator<char>(file),
+         std::istream_iterator<char>(),
+         std::back_inserter(in));
+
+    return in;
+}
+
+}
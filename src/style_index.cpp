@@ -0,0 +1,111 @@
+#include <style_index.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+#include <boost/algorithm/string.hpp>
+
+namespace carto {
+
+namespace al = boost::algorithm;
+
+style_index::style_index()
+  : symbols_(),
+    postings_(),
+    names_() { }
+
+std::vector<std::string> style_index::selectors(std::string name)
+{
+    // remove attachment from style name
+    size_t loc = name.find("::");
+    if (loc != std::string::npos) {
+        al::erase_tail(name, name.length()-loc);
+    }
+
+    al::trim_if(name,al::is_any_of(". "));
+    std::vector<std::string> selectors;
+    al::split(selectors, name, al::is_any_of(". "));
+
+    return selectors;
+}
+
+std::size_t style_index::add_style(std::string const& name)
+{
+    std::size_t style = names_.size();
+    names_.push_back(name);
+
+    std::vector<std::string> sel = selectors(name);
+
+    for (std::vector<std::string>::const_iterator it = sel.begin();
+         it != sel.end();
+         ++it) {
+        symbols_type::iterator sym = symbols_.find(*it);
+        if (sym == symbols_.end()) {
+            sym = symbols_.insert(std::make_pair(*it, postings_.size())).first;
+            postings_.push_back(postings_type());
+        }
+
+        // styles are added in order, so postings stay sorted and a repeated
+        // selector within one name only has to look at the back
+        postings_type& post = postings_[sym->second];
+        if (post.empty() || post.back() != style)
+            post.push_back(style);
+    }
+
+    return style;
+}
+
+struct postings_size_comparator {
+    bool operator()(style_index::postings_type const* lhs,
+                    style_index::postings_type const* rhs) const {
+        return lhs->size() < rhs->size();
+    }
+};
+
+style_index::postings_type style_index::match(std::vector<std::string> const& layer_selectors) const
+{
+    postings_type result;
+
+    if (layer_selectors.empty()) {
+        for (std::size_t i = 0; i < names_.size(); ++i)
+            result.push_back(i);
+        return result;
+    }
+
+    std::vector<postings_type const*> lists;
+
+    for (std::vector<std::string>::const_iterator it = layer_selectors.begin();
+         it != layer_selectors.end();
+         ++it) {
+        symbols_type::const_iterator sym = symbols_.find(*it);
+        if (sym == symbols_.end())
+            return result;
+        lists.push_back(&postings_[sym->second]);
+    }
+
+    // intersect smallest first so the working set only ever shrinks
+    std::sort(lists.begin(), lists.end(), postings_size_comparator());
+
+    result = *lists.front();
+    for (std::size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+        postings_type narrowed;
+        std::set_intersection(result.begin(), result.end(),
+                              lists[i]->begin(), lists[i]->end(),
+                              std::back_inserter(narrowed));
+        result.swap(narrowed);
+    }
+
+    return result;
+}
+
+std::string const& style_index::style_name(std::size_t i) const
+{
+    return names_[i];
+}
+
+std::size_t style_index::size() const
+{
+    return names_.size();
+}
+
+}
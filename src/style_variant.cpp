@@ -0,0 +1,78 @@
+#include <style_variant.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <iterator>
+
+#include <mapnik/config_error.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <intermediate/mss_parser.hpp>
+#include <parse/carto_grammar.hpp>
+#include <utility/environment.hpp>
+#include <utility/utree.hpp>
+
+namespace carto {
+
+using mapnik::config_error;
+
+style_variant parse_variant(std::string const& in, std::string const& name,
+                            bool strict, std::string const& path)
+{
+    intermediate::mss_parser parser(in, strict, path);
+    style_variant variant(name);
+    style_env env;
+
+    utree const& root_node = parser.tree.ast();
+
+    for (utree::const_iterator it = root_node.begin(); it != root_node.end(); ++it) {
+        int node_type = parser.tree.annotations(it->tag()).second;
+
+        switch((carto_node_type) node_type) {
+            case carto_variable:
+            {
+                std::string var = detail::as<std::string>(it->front());
+                parser.parse_variable(*it, env);
+                variant.vars[var] = env.vars.lookup(var);
+                break;
+            }
+            case carto_comment:
+                break;
+            default:
+            {
+                std::stringstream err;
+                err << "Variant " << name << " may only define variables, found node type "
+                    << node_type << " at " << parser.tree.annotations(it->tag()).first.get_string();
+                throw config_error(err.str());
+            }
+        }
+    }
+
+    variant.annotations = parser.tree.annotations();
+    return variant;
+}
+
+style_variant load_variant(std::string filename, bool strict)
+{
+    std::ifstream file(filename.c_str(), std::ios_base::in);
+
+    if (!file)
+        throw config_error(std::string("Cannot open input file: ")+filename);
+
+    std::string in;
+    file.unsetf(std::ios::skipws);
+    copy(std::istream_iterator<char>(file),
+         std::istream_iterator<char>(),
+         std::back_inserter(in));
+
+    #if (BOOST_FILESYSTEM_VERSION == 3)
+    std::string name = boost::filesystem::path(filename).stem().string();
+    #else // v2
+    std::string name = boost::filesystem::path(filename).stem();
+    #endif
+
+    return parse_variant(in, name, strict, filename);
+}
+
+}
@@ -0,0 +1,236 @@
+#include <utility/alloc_stats.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <new>
+#include <ostream>
+
+#include <pthread.h>
+
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#define CARTO_BLOCK_SIZE(ptr) malloc_size(ptr)
+#else
+#include <malloc.h>
+#define CARTO_BLOCK_SIZE(ptr) malloc_usable_size(ptr)
+#endif
+
+namespace carto {
+
+namespace {
+
+struct phase_counts {
+    char const* name;
+    std::size_t allocations;
+    std::size_t bytes;
+    std::size_t peak_live;
+};
+
+// Plain data only: operator new runs before any constructor and after
+// every destructor of the program. Phase 0 collects what isn't in one.
+std::size_t const max_phases = 32;
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+bool enabled = false;
+phase_counts phases[max_phases] = { { "other", 0, 0, 0 } };
+std::size_t phase_count = 1;
+std::size_t current = 0;
+std::size_t live = 0;
+std::size_t peak_live = 0;
+
+#ifdef CARTO_ALLOC_STATS
+
+void* allocate(std::size_t size)
+{
+    if (size == 0) size = 1;
+
+    void *ptr;
+    while (!(ptr = std::malloc(size))) {
+        std::new_handler handler = std::set_new_handler(0);
+        std::set_new_handler(handler);
+        if (!handler) return 0;
+        handler();
+    }
+
+    if (enabled) {
+        std::size_t block = CARTO_BLOCK_SIZE(ptr);
+
+        pthread_mutex_lock(&mutex);
+        phase_counts& counts = phases[current];
+        ++counts.allocations;
+        counts.bytes += block;
+        live += block;
+        if (live > counts.peak_live) counts.peak_live = live;
+        if (live > peak_live) peak_live = live;
+        pthread_mutex_unlock(&mutex);
+    }
+
+    return ptr;
+}
+
+void deallocate(void *ptr)
+{
+    if (!ptr) return;
+
+    if (enabled) {
+        std::size_t block = CARTO_BLOCK_SIZE(ptr);
+
+        pthread_mutex_lock(&mutex);
+        // blocks from before tracking started aren't in live
+        live -= block < live ? block : live;
+        pthread_mutex_unlock(&mutex);
+    }
+
+    std::free(ptr);
+}
+
+#endif
+
+}
+
+bool alloc_tracking_available()
+{
+#ifdef CARTO_ALLOC_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void enable_alloc_tracking()
+{
+    enabled = alloc_tracking_available();
+}
+
+bool alloc_tracking_enabled()
+{
+    return enabled;
+}
+
+char const* set_alloc_phase(char const* phase)
+{
+    if (!enabled) return 0;
+
+    pthread_mutex_lock(&mutex);
+
+    char const* previous = current ? phases[current].name : 0;
+
+    std::size_t index = 0;
+    if (phase) {
+        for (index = 1; index < phase_count; ++index) {
+            if (std::strcmp(phases[index].name, phase) == 0) break;
+        }
+        if (index == phase_count && phase_count < max_phases) {
+            phases[index].name = phase;
+            ++phase_count;
+        }
+        if (index == max_phases) index = 0;
+    }
+
+    current = index;
+    if (live > phases[current].peak_live) phases[current].peak_live = live;
+
+    pthread_mutex_unlock(&mutex);
+    return previous;
+}
+
+void write_alloc_stats(std::ostream& out)
+{
+    pthread_mutex_lock(&mutex);
+    phase_counts copy[max_phases];
+    std::size_t count = phase_count, peak = peak_live;
+    std::memcpy(copy, phases, sizeof(phases));
+    pthread_mutex_unlock(&mutex);
+
+    // the stream allocates, so write from the copy
+    out << "### ALLOC: " << std::left << std::setw(24) << "phase" << std::right
+        << std::setw(12) << "allocations" << std::setw(14) << "bytes" << std::setw(14) << "peak live" << "\n";
+    // phases in the order they started, then other
+    for (std::size_t i = 1; i <= count; ++i) {
+        phase_counts const& counts = copy[i < count ? i : 0];
+        out << "### ALLOC: " << std::left << std::setw(24) << counts.name << std::right
+            << std::setw(12) << counts.allocations << std::setw(14) << counts.bytes
+            << std::setw(14) << counts.peak_live << "\n";
+    }
+    out << "### ALLOC: " << std::left << std::setw(24) << "peak live" << std::right
+        << std::setw(40) << peak << "\n";
+}
+
+}
+
+#ifdef CARTO_ALLOC_STATS
+
+#if __cplusplus >= 201103L
+#define CARTO_THROWS_BAD_ALLOC
+#define CARTO_NO_THROW noexcept
+#else
+#define CARTO_THROWS_BAD_ALLOC throw(std::bad_alloc)
+#define CARTO_NO_THROW throw()
+#endif
+
+void* operator new(std::size_t size) CARTO_THROWS_BAD_ALLOC
+{
+    void *ptr = carto::allocate(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](std::size_t size) CARTO_THROWS_BAD_ALLOC
+{
+    void *ptr = carto::allocate(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) CARTO_NO_THROW
+{
+    try {
+        return carto::allocate(size);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) CARTO_NO_THROW
+{
+    try {
+        return carto::allocate(size);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void operator delete(void *ptr) CARTO_NO_THROW
+{
+    carto::deallocate(ptr);
+}
+
+void operator delete[](void *ptr) CARTO_NO_THROW
+{
+    carto::deallocate(ptr);
+}
+
+void operator delete(void *ptr, std::nothrow_t const&) CARTO_NO_THROW
+{
+    carto::deallocate(ptr);
+}
+
+void operator delete[](void *ptr, std::nothrow_t const&) CARTO_NO_THROW
+{
+    carto::deallocate(ptr);
+}
+
+// C++14 compilers call these when the size is known
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, std::size_t) CARTO_NO_THROW
+{
+    carto::deallocate(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) CARTO_NO_THROW
+{
+    carto::deallocate(ptr);
+}
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+#include <utility/stats.hpp>
+#include <utility/alloc_stats.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace carto {
+
+void compile_stats::add_time(std::string const& phase, double ms)
+{
+    timings_type::iterator it = timings.find(phase);
+    if (it == timings.end()) {
+        it = timings.insert(std::make_pair(phase, timing())).first;
+        order.push_back(phase);
+    }
+
+    it->second.ms += ms;
+    ++it->second.calls;
+}
+
+void compile_stats::count(std::string const& counter, std::size_t n)
+{
+    counters[counter] += n;
+}
+
+void compile_stats::write_text(std::ostream& out) const
+{
+    for (std::vector<std::string>::const_iterator it = order.begin(); it != order.end(); ++it) {
+        timing const& t = timings.find(*it)->second;
+        out << "### STATS: " << std::left << std::setw(24) << *it << std::right
+            << std::fixed << std::setprecision(3) << std::setw(12) << t.ms << " ms";
+        if (t.calls > 1)
+            out << " (" << t.calls << " calls)";
+        out << "\n";
+    }
+
+    for (counters_type::const_iterator it = counters.begin(); it != counters.end(); ++it)
+        out << "### STATS: " << std::left << std::setw(24) << it->first << std::right
+            << std::setw(12) << it->second << "\n";
+}
+
+// phase and counter names are plain words, nothing to escape
+void compile_stats::write_json(std::ostream& out) const
+{
+    out << "{\"timings\": {";
+    for (std::vector<std::string>::const_iterator it = order.begin(); it != order.end(); ++it) {
+        timing const& t = timings.find(*it)->second;
+        out << (it == order.begin() ? "" : ", ") << "\"" << *it << "\": {\"ms\": "
+            << std::fixed << std::setprecision(3) << t.ms << ", \"calls\": " << t.calls << "}";
+    }
+
+    out << "}, \"counters\": {";
+    for (counters_type::const_iterator it = counters.begin(); it != counters.end(); ++it)
+        out << (it == counters.begin() ? "" : ", ") << "\"" << it->first << "\": " << it->second;
+    out << "}}\n";
+}
+
+stat_timer::stat_timer(compile_stats *stats, char const* phase)
+  : stats_(stats),
+    phase_(phase),
+    outer_phase_(0),
+    start_()
+{
+    if (!stats_) return;
+
+    outer_phase_ = set_alloc_phase(phase_);
+    start_ = boost::posix_time::microsec_clock::universal_time();
+}
+
+stat_timer::~stat_timer()
+{
+    stop();
+}
+
+void stat_timer::stop()
+{
+    if (!stats_) return;
+
+    boost::posix_time::time_duration elapsed =
+        boost::posix_time::microsec_clock::universal_time() - start_;
+    stats_->add_time(phase_, elapsed.total_microseconds() / 1000.0);
+    set_alloc_phase(outer_phase_);
+    stats_ = 0;
+}
+
+}
@@ -0,0 +1,91 @@
+#include <utility/thread_pool.hpp>
+
+#include <boost/bind.hpp>
+
+namespace carto {
+
+thread_pool::thread_pool(unsigned threads)
+  : active_(0),
+    error_(),
+    size_(threads ? threads : boost::thread::hardware_concurrency()),
+    stopping_(false)
+{
+    if (size_ == 0) size_ = 1;
+
+    for (unsigned i = 0; i < size_; ++i)
+        threads_.create_thread(boost::bind(&thread_pool::run, this));
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        stopping_ = true;
+    }
+    work_cond_.notify_all();
+    threads_.join_all();
+}
+
+void thread_pool::submit(task_type const& task)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        tasks_.push_back(task);
+    }
+    work_cond_.notify_one();
+}
+
+void thread_pool::wait()
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!tasks_.empty() || active_ != 0)
+        done_cond_.wait(lock);
+
+    if (error_) {
+        boost::exception_ptr error = error_;
+        error_ = boost::exception_ptr();
+        boost::rethrow_exception(error);
+    }
+}
+
+unsigned thread_pool::size() const
+{
+    return size_;
+}
+
+void thread_pool::run()
+{
+    for (;;) {
+        task_type task;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while (tasks_.empty() && !stopping_)
+                work_cond_.wait(lock);
+
+            if (tasks_.empty())
+                return;
+
+            task = tasks_.front();
+            tasks_.pop_front();
+            ++active_;
+        }
+
+        boost::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = boost::current_exception();
+        }
+
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            if (error && !error_)
+                error_ = error;
+            --active_;
+            if (tasks_.empty() && active_ == 0)
+                done_cond_.notify_all();
+        }
+    }
+}
+
+}
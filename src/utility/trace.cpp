@@ -0,0 +1,115 @@
+#include <utility/trace.hpp>
+
+#include <ostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace carto {
+
+compile_trace::compile_trace()
+  : mutex_(),
+    start_(boost::posix_time::microsec_clock::universal_time()),
+    events_(),
+    threads_() { }
+
+void compile_trace::begin(char const* category, std::string const& name)
+{
+    record('B', category, name);
+}
+
+void compile_trace::end(char const* category, std::string const& name)
+{
+    record('E', category, name);
+}
+
+std::size_t compile_trace::size() const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    return events_.size();
+}
+
+void compile_trace::record(char phase, char const* category, std::string const& name)
+{
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    std::map<boost::thread::id, unsigned>::iterator it = threads_.find(boost::this_thread::get_id());
+    if (it == threads_.end())
+        it = threads_.insert(std::make_pair(boost::this_thread::get_id(), threads_.size() + 1)).first;
+
+    event e;
+    e.phase = phase;
+    e.category = category;
+    e.name = name;
+    e.timestamp = (now - start_).total_microseconds();
+    e.thread = it->second;
+    events_.push_back(e);
+}
+
+static void write_string(std::ostream& out, std::string const& str)
+{
+    static char const hex[] = "0123456789abcdef";
+
+    out << '"';
+    for (std::string::const_iterator it = str.begin(); it != str.end(); ++it) {
+        unsigned char c = *it;
+        if (c == '"' || c == '\\')
+            out << '\\' << *it;
+        else if (c < 0x20)
+            out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+        else
+            out << *it;
+    }
+    out << '"';
+}
+
+void compile_trace::write_json(std::ostream& out) const
+{
+    boost::mutex::scoped_lock lock(mutex_);
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+    // thread 1 is the one that recorded first, normally the main thread
+    bool first = true;
+    for (std::map<boost::thread::id, unsigned>::const_iterator it = threads_.begin(); it != threads_.end(); ++it) {
+        out << (first ? "\n" : ",\n")
+            << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << it->second
+            << ", \"args\": {\"name\": \"" << (it->second == 1 ? "main" : "worker") << "\"}}";
+        first = false;
+    }
+
+    for (std::vector<event>::const_iterator it = events_.begin(); it != events_.end(); ++it) {
+        out << (first ? "\n" : ",\n") << "{\"name\": ";
+        write_string(out, it->name);
+        out << ", \"cat\": \"" << it->category << "\", \"ph\": \"" << it->phase
+            << "\", \"ts\": " << it->timestamp << ", \"pid\": 1, \"tid\": " << it->thread << "}";
+        first = false;
+    }
+
+    out << "\n]}\n";
+}
+
+trace_scope::trace_scope(compile_trace *trace, char const* category, std::string const& name)
+  : trace_(trace),
+    category_(category),
+    name_(trace ? name : std::string())
+{
+    if (trace_)
+        trace_->begin(category_, name_);
+}
+
+trace_scope::~trace_scope()
+{
+    stop();
+}
+
+void trace_scope::stop()
+{
+    if (!trace_) return;
+
+    trace_->end(category_, name_);
+    trace_ = 0;
+}
+
+}
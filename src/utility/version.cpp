@@ -26,9 +26,8 @@ bool version_from_string(std::string min_version_string)
         {
             n[i] = boost::lexical_cast<int>(boost::trim_copy(*beg));
         }
-        catch (boost::bad_lexical_cast & ex)
+        catch (boost::bad_lexical_cast &)
         {
-            std::clog << *beg << " : " << ex.what() << "\n";
             break;
         }
         if (i==2) 
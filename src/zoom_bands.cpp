@@ -0,0 +1,134 @@
+#include <zoom_bands.hpp>
+
+#include <set>
+#include <limits>
+#include <sstream>
+
+#include <mapnik/layer.hpp>
+#include <mapnik/rule.hpp>
+#include <mapnik/feature_type_style.hpp>
+#include <mapnik/config_error.hpp>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <intermediate/mss_to_mapnik.hpp>
+
+namespace carto {
+
+std::string zoom_band::get_string() const
+{
+    std::stringstream oss;
+    oss << min_zoom;
+    if (max_zoom != min_zoom)
+        oss << "-" << max_zoom;
+    return oss.str();
+}
+
+std::vector<zoom_band> parse_zoom_bands(std::string const& spec)
+{
+    using intermediate::zoom_levels;
+
+    std::vector<zoom_band> bands;
+
+    if (spec.empty()) {
+        for (unsigned z = 0; z < zoom_levels; ++z)
+            bands.push_back(zoom_band(z, z));
+        return bands;
+    }
+
+    std::vector<std::string> parts;
+    boost::algorithm::split(parts, spec, boost::algorithm::is_any_of(","));
+
+    for (std::vector<std::string>::const_iterator it = parts.begin(); it != parts.end(); ++it) {
+        std::vector<std::string> ends;
+        boost::algorithm::split(ends, *it, boost::algorithm::is_any_of("-"));
+
+        zoom_band band;
+        try {
+            band.min_zoom = boost::lexical_cast<unsigned>(boost::algorithm::trim_copy(ends.front()));
+            band.max_zoom = boost::lexical_cast<unsigned>(boost::algorithm::trim_copy(ends.back()));
+        } catch (boost::bad_lexical_cast&) {
+            throw mapnik::config_error("Invalid zoom band: " + *it);
+        }
+
+        if (ends.size() > 2 || band.min_zoom > band.max_zoom || band.max_zoom >= zoom_levels)
+            throw mapnik::config_error("Invalid zoom band: " + *it);
+
+        bands.push_back(band);
+    }
+
+    return bands;
+}
+
+mapnik::Map specialize_map(mapnik::Map const& map, zoom_band const& band)
+{
+    mapnik::Map result(map);
+
+    // scales within the band lie in (band_min, band_max)
+    double band_min = intermediate::zoom_scale_range(band.max_zoom).first,
+           band_max = intermediate::zoom_scale_range(band.min_zoom).second;
+
+    std::set<std::string> removed;
+
+    for (mapnik::Map::style_iterator st_it = result.styles().begin();
+         st_it != result.styles().end();
+         ++st_it) {
+        mapnik::feature_type_style::rules &rules = (*st_it).second.get_rules_nonconst();
+        mapnik::feature_type_style::rules kept;
+
+        for (mapnik::feature_type_style::rules::const_iterator r_it = rules.begin();
+             r_it != rules.end();
+             ++r_it) {
+            if (r_it->get_min_scale() >= band_max || r_it->get_max_scale() <= band_min)
+                continue;
+
+            kept.push_back(*r_it);
+
+            if (r_it->get_min_scale() <= band_min && r_it->get_max_scale() >= band_max) {
+                kept.back().set_min_scale(0);
+                kept.back().set_max_scale(std::numeric_limits<double>::infinity());
+            }
+        }
+
+        rules.swap(kept);
+
+        if (rules.empty())
+            removed.insert((*st_it).first);
+    }
+
+    for (std::set<std::string>::const_iterator it = removed.begin(); it != removed.end(); ++it)
+        result.remove_style(*it);
+
+    std::vector<mapnik::layer> &layers = result.layers();
+    std::vector<mapnik::layer> kept;
+
+    for (std::vector<mapnik::layer>::const_iterator l_it = layers.begin();
+         l_it != layers.end();
+         ++l_it) {
+        if (l_it->getMinZoom() >= band_max || l_it->getMaxZoom() <= band_min)
+            continue;
+
+        mapnik::layer lyr(*l_it);
+        std::vector<std::string> &styles = lyr.styles();
+
+        std::vector<std::string> kept_styles;
+        for (std::vector<std::string>::const_iterator st_it = styles.begin();
+             st_it != styles.end();
+             ++st_it) {
+            if (!removed.count(*st_it))
+                kept_styles.push_back(*st_it);
+        }
+
+        if (kept_styles.empty()) continue;
+
+        styles.swap(kept_styles);
+        kept.push_back(lyr);
+    }
+
+    layers.swap(kept);
+
+    return result;
+}
+
+}
@@ -0,0 +1,251 @@
+// Compiler benchmark: compiles each MML project found in the given
+// directories a number of times over, as carto does with lazy
+// datasources, and writes min, median and p99 milliseconds per phase as
+// JSON. Phases are file load, parse (MML and stylesheets, stylesheet
+// files being read as the compiler reads them), evaluate (variables and
+// expressions), cascade, generate (Mapnik styles) and save (XML); all but
+// load are read from the compiler's own --stats timers.
+//
+//   tools/bench [-n runs] output.json directory...
+
+#include <mml_parser.hpp>
+#include <parse_cache.hpp>
+#include <parse/mml_reader.hpp>
+#include <utility/stats.hpp>
+
+#include <mapnik/map.hpp>
+#include <mapnik/save_map.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+typedef std::vector<double> times_type;
+
+static char const* const phases[] = {
+    "load", "parse", "evaluate", "cascade", "generate", "save"
+};
+static std::size_t const phase_count = sizeof(phases) / sizeof(phases[0]);
+
+struct project_result {
+    std::string name;
+    std::string error;
+    std::size_t rules;
+    std::vector<times_type> times;
+
+    project_result(std::string const& name_)
+      : name(name_), error(), rules(0), times(phase_count) { }
+};
+
+static boost::posix_time::ptime now()
+{
+    return boost::posix_time::microsec_clock::universal_time();
+}
+
+static double elapsed_ms(boost::posix_time::ptime start)
+{
+    return (now() - start).total_microseconds() / 1000.0;
+}
+
+// the files of the stylesheet entries of an MML, resolved the way
+// mml_parser::load_stylesheet does; other entries are inline source
+static std::vector<std::string> find_stylesheets(carto::mml_document const& doc,
+                                                 std::string const& mml_path)
+{
+    std::vector<std::string> files;
+    fs::path parent_dir = fs::path(mml_path).parent_path();
+
+    for (std::size_t i = 0; i < doc.stylesheets.size(); ++i) {
+        std::string const& data = doc.stylesheets[i];
+        fs::path abs_path(data), rel_path = parent_dir / abs_path;
+
+        if (fs::exists(abs_path))
+            files.push_back(abs_path.string());
+        else if (fs::exists(rel_path))
+            files.push_back(rel_path.string());
+    }
+
+    return files;
+}
+
+// milliseconds the compiler spent in phase
+static double phase_ms(carto::compile_stats const& stats, char const* phase)
+{
+    carto::compile_stats::timings_type::const_iterator it = stats.timings.find(phase);
+    return it == stats.timings.end() ? 0 : it->second.ms;
+}
+
+static void bench_project(std::string const& mml_path, unsigned runs, project_result& result)
+{
+    // load
+    std::string mml_source = carto::read_source(mml_path);
+    std::vector<std::string> sheets =
+        find_stylesheets(carto::read_mml(mml_source, mml_path), mml_path);
+
+    for (unsigned r = 0; r < runs; ++r) {
+        boost::posix_time::ptime start = now();
+        mml_source = carto::read_source(mml_path);
+        for (std::size_t i = 0; i < sheets.size(); ++i)
+            carto::read_source(sheets[i]);
+        result.times[0].push_back(elapsed_ms(start));
+    }
+
+    // everything else, as carto compiles the project
+    for (unsigned r = 0; r < runs; ++r) {
+        carto::compile_stats stats;
+        mapnik::Map map(800, 600);
+
+        carto::stat_timer parse_timer(&stats, "mml parse");
+        carto::mml_parser parser(mml_source, false, mml_path);
+        parse_timer.stop();
+
+        parser.lazy_datasources = true;
+        parser.log = 0;
+        parser.stats = &stats;
+        parser.parse_map(map);
+
+        carto::stat_timer save_timer(&stats, "save");
+        std::string xml = mapnik::save_map_to_string(map, false);
+        save_timer.stop();
+
+        result.times[1].push_back(phase_ms(stats, "mml parse") + phase_ms(stats, "mss parse"));
+        result.times[2].push_back(phase_ms(stats, "evaluate"));
+        result.times[3].push_back(phase_ms(stats, "cascade"));
+        result.times[4].push_back(phase_ms(stats, "generate"));
+        result.times[5].push_back(phase_ms(stats, "save"));
+
+        result.rules = stats.counters["rules after cascade"];
+    }
+}
+
+static double percentile(times_type times, double p)
+{
+    if (times.empty()) return 0;
+    std::sort(times.begin(), times.end());
+    return times[static_cast<std::size_t>(p * (times.size() - 1) + 0.5)];
+}
+
+static std::string json_string(std::string const& str)
+{
+    std::ostringstream out;
+    out << '"';
+    for (std::string::const_iterator it = str.begin(); it != str.end(); ++it) {
+        switch (*it) {
+            case '"':  out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(*it) < 0x20)
+                    out << "\\u00" << "0123456789abcdef"[(*it >> 4) & 0xf] << "0123456789abcdef"[*it & 0xf];
+                else
+                    out << *it;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+static void write_phases(std::ostream& out, std::vector<times_type> const& times)
+{
+    out << "{";
+    for (std::size_t p = 0; p < phase_count; ++p) {
+        out << (p ? ", " : "") << json_string(phases[p]) << ": {"
+            << "\"min\": " << percentile(times[p], 0)
+            << ", \"median\": " << percentile(times[p], 0.5)
+            << ", \"p99\": " << percentile(times[p], 0.99) << "}";
+    }
+    out << "}";
+}
+
+int main(int argc, char **argv)
+{
+    unsigned runs = 20;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "-n" && i + 1 < argc)
+            runs = boost::lexical_cast<unsigned>(argv[++i]);
+        else
+            args.push_back(argv[i]);
+    }
+
+    if (args.size() < 2 || runs == 0) {
+        std::cout << "usage: bench [-n runs] output.json directory...\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> projects;
+    for (std::size_t i = 1; i < args.size(); ++i) {
+        std::vector<std::string> found;
+        for (fs::directory_iterator it(args[i]); it != fs::directory_iterator(); ++it) {
+            if (it->path().extension() == ".mml")
+                found.push_back(it->path().string());
+        }
+        std::sort(found.begin(), found.end());
+        projects.insert(projects.end(), found.begin(), found.end());
+    }
+
+    std::vector<project_result> results;
+    std::vector<times_type> totals(phase_count, times_type(runs, 0.0));
+
+    for (std::size_t i = 0; i < projects.size(); ++i) {
+        project_result result(projects[i]);
+
+        try {
+            bench_project(projects[i], runs, result);
+        } catch (std::exception& e) {
+            result.error = e.what();
+        }
+
+        if (result.error.empty()) {
+            for (std::size_t p = 0; p < phase_count; ++p)
+                for (unsigned r = 0; r < runs; ++r)
+                    totals[p][r] += result.times[p][r];
+        }
+
+        std::cout << result.name << ": ";
+        if (!result.error.empty()) {
+            std::cout << "error: " << result.error << "\n";
+        } else {
+            for (std::size_t p = 0; p < phase_count; ++p)
+                std::cout << (p ? ", " : "") << phases[p] << " " << percentile(result.times[p], 0.5);
+            std::cout << " ms (median)\n";
+        }
+
+        results.push_back(result);
+    }
+
+    std::ofstream out(args[0].c_str());
+    if (!out.is_open()) {
+        std::cout << "Error: could not write " << args[0] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    out << "{\n  \"runs\": " << runs << ",\n  \"total\": ";
+    write_phases(out, totals);
+    out << ",\n  \"projects\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        out << (i ? "," : "") << "\n    {\"name\": " << json_string(results[i].name);
+        if (!results[i].error.empty()) {
+            out << ", \"error\": " << json_string(results[i].error) << "}";
+            continue;
+        }
+        out << ", \"rules\": " << results[i].rules << ", \"phases\": ";
+        write_phases(out, results[i].times);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+
+    return 0;
+}
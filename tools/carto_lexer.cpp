@@ -0,0 +1,335 @@
+#include "carto_lexer.hpp"
+
+#include <parse/skipper.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include <boost/spirit/include/qi.hpp>
+
+#include <mapnik/css_color_grammar.hpp>
+
+namespace carto {
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool is_hex_digit(char c)
+{
+    return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static bool is_name_start(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool is_name_char(char c)
+{
+    return is_name_start(c) || is_digit(c) || c == '-';
+}
+
+static unsigned hex_value(char c)
+{
+    if (is_digit(c)) return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return c - 'A' + 10;
+}
+
+// named colors as css_color_grammar matches them, from its own table
+static bool find_named_color(char const* begin, char const* end, mapnik::color& color)
+{
+    static mapnik::css_color_grammar<char const*> const css_color;
+    char const* p = begin;
+    return boost::spirit::qi::phrase_parse(p, end, css_color, boost::spirit::ascii::space, color) && p == end;
+}
+
+// #rgb, #rgba, #rrggbb or #rrggbbaa
+static bool hex_color(char const* begin, char const* end, mapnik::color& color)
+{
+    std::size_t n = end - begin;
+    if (n != 3 && n != 4 && n != 6 && n != 8) return false;
+    for (char const* p = begin; p != end; ++p)
+        if (!is_hex_digit(*p)) return false;
+
+    unsigned c[4] = { 0, 0, 0, 255 };
+    if (n <= 4) {
+        for (std::size_t i = 0; i < n; ++i)
+            c[i] = hex_value(begin[i]) * 17;
+    } else {
+        for (std::size_t i = 0; i < n / 2; ++i)
+            c[i] = hex_value(begin[2 * i]) * 16 + hex_value(begin[2 * i + 1]);
+    }
+
+    color = mapnik::color(c[0], c[1], c[2], c[3]);
+    return true;
+}
+
+static int clip_channel(int value)
+{
+    return std::max(0, std::min(255, value));
+}
+
+// the number conversion of the character grammar, so values are the same
+static bool parse_double(char const*& p, char const* end, double& value)
+{
+    return boost::spirit::qi::parse(p, end, boost::spirit::qi::double_, value);
+}
+
+static char const* skip_space(char const* p, char const* end)
+{
+    while (p != end && is_space(*p)) ++p;
+    return p;
+}
+
+static bool skip_char(char const*& p, char const* end, char c)
+{
+    p = skip_space(p, end);
+    if (p == end || *p != c) return false;
+    ++p;
+    return true;
+}
+
+// one to three digits
+static bool parse_channel(char const*& p, char const* end, unsigned& value)
+{
+    p = skip_space(p, end);
+    value = 0;
+    std::size_t n = 0;
+    for (; p != end && n < 3 && is_digit(*p); ++p, ++n)
+        value = value * 10 + (*p - '0');
+    return n > 0;
+}
+
+static bool parse_percent_channel(char const*& p, char const* end, unsigned& value)
+{
+    double percent;
+    p = skip_space(p, end);
+    if (!parse_double(p, end, percent) || !skip_char(p, end, '%')) return false;
+    value = clip_channel(int((255.0 * percent) / 100.0 + 0.5));
+    return true;
+}
+
+// the arguments of rgb(...) or rgba(...) from the opening parenthesis,
+// either three channels of 0 to 255 or three percentages, then an
+// optional opacity; p is left after the closing parenthesis
+static bool color_function(char const*& p, char const* end, mapnik::color& color)
+{
+    char const* args = p;
+    for (int percent = 0; percent < 2; ++percent) {
+        p = args;
+        unsigned c[4] = { 0, 0, 0, 255 };
+        bool ok = skip_char(p, end, '(');
+        for (int i = 0; ok && i < 3; ++i) {
+            ok = (i == 0 || skip_char(p, end, ',')) &&
+                 (percent ? parse_percent_channel(p, end, c[i]) : parse_channel(p, end, c[i]));
+        }
+
+        if (ok && skip_char(p, end, ',')) {
+            double opacity;
+            p = skip_space(p, end);
+            ok = parse_double(p, end, opacity);
+            c[3] = clip_channel(int(255.0 * opacity + 0.5));
+        }
+
+        if (ok && skip_char(p, end, ')')) {
+            color = mapnik::color(c[0], c[1], c[2], c[3]);
+            return true;
+        }
+    }
+    return false;
+}
+
+static char const* const two_char_punctuation[] = { "::", ">=", "<=", "==", "!=", "<>", "&&", "||" };
+
+static bool is_punctuation(char c)
+{
+    return c != 0 && std::strchr("{}()[],;:+-*/%.=<>!", c) != 0;
+}
+
+// Keeps the line and column of a position in the source, counting as
+// position_iterator does: a tab is two columns and \r\n or \n\r one line.
+class location_tracker {
+public:
+    explicit location_tracker(char const* begin)
+      : position_(begin),
+        location_(1, 0),
+        prev_(0) { }
+
+    source_location const& advance(char const* to)
+    {
+        // tokens are short, comments and runs of whitespace may not be
+        if (to - position_ >= 32) {
+            advance_location(location_, prev_, position_, to);
+            position_ = to;
+        }
+
+        for (; position_ != to; ++position_) {
+            char c = *position_;
+            switch (c) {
+                case '\r':
+                    if (prev_ != '\n') {
+                        ++location_.line;
+                        location_.column = 0;
+                    }
+                    break;
+                case '\n':
+                    if (prev_ != '\r') {
+                        ++location_.line;
+                        location_.column = 0;
+                    }
+                    break;
+                case '\t':
+                    location_.column += 2;
+                    break;
+                default:
+                    ++location_.column;
+                    break;
+            }
+            prev_ = c;
+        }
+        return location_;
+    }
+
+private:
+    char const* position_;
+    source_location location_;
+    char prev_;
+};
+
+void tokenize_carto(std::string const& in, carto_tokens& tokens, bool preserve_comments)
+{
+    char const* const begin = in.data();
+    char const* const end = begin + in.size();
+    char const* p = begin;
+    location_tracker tracker(begin);
+
+    tokens.clear();
+    tokens.reserve(in.size() / 4 + 1);
+
+    while (true) {
+        if (p != end && (is_space(*p) || *p == '/'))
+            p = scan_space(p, end, !preserve_comments);
+
+        carto_token token;
+        token.begin = p - begin;
+        token.location = tracker.advance(p);
+
+        if (p == end) {
+            token.end = token.begin;
+            tokens.push_back(token);
+            return;
+        }
+
+        char const* start = p;
+        char c = *p;
+
+        if (is_digit(c) || (c == '.' && p + 1 != end && is_digit(p[1]))) {
+            while (p != end && is_digit(*p)) ++p;
+            // a trailing dot is part of the number, as for qi::double_,
+            // unless a name follows
+            if (p != end && *p == '.' && (p + 1 == end || !is_name_start(p[1]))) {
+                ++p;
+                while (p != end && is_digit(*p)) ++p;
+            }
+            if (p != end && (*p == 'e' || *p == 'E')) {
+                char const* exponent = p + 1;
+                if (exponent != end && (*exponent == '+' || *exponent == '-')) ++exponent;
+                if (exponent != end && is_digit(*exponent)) {
+                    p = exponent;
+                    while (p != end && is_digit(*p)) ++p;
+                }
+            }
+
+            char const* number = start;
+            parse_double(number, p, token.number);
+            token.type = token_number;
+
+            if (p != end && *p == '%') {
+                ++p;
+                token.type = token_dimension;
+            } else if (p != end && is_name_start(*p)) {
+                while (p != end && is_name_char(*p)) ++p;
+                token.type = token_dimension;
+            }
+        } else if (is_name_start(c)) {
+            while (p != end && is_name_char(*p)) ++p;
+            token.type = token_identifier;
+
+            std::size_t n = p - start;
+            if ((n == 3 && std::strncmp(start, "rgb", 3) == 0) ||
+                (n == 4 && std::strncmp(start, "rgba", 4) == 0)) {
+                char const* args = p;
+                if (color_function(args, end, token.color)) {
+                    p = args;
+                    token.type = token_color_function;
+                    token.is_color = true;
+                }
+            } else {
+                token.is_color = find_named_color(start, p, token.color);
+            }
+        } else if (c == '#') {
+            ++p;
+            while (p != end && is_name_char(*p)) ++p;
+            token.is_color = hex_color(start + 1, p, token.color);
+            token.type = token.is_color ? token_color : token_hash;
+        } else if (c == '@') {
+            ++p;
+            if (p != end && is_name_start(*p)) {
+                while (p != end && is_name_char(*p)) ++p;
+                token.type = token_variable;
+            } else {
+                token.type = token_invalid;
+            }
+        } else if (c == '\'' || c == '"') {
+            char const* close = std::find(p + 1, end, c);
+            if (close == end) {
+                p = end;
+                token.type = token_invalid;
+            } else {
+                p = close + 1;
+                token.type = token_string;
+            }
+        } else if (c == '/' && p + 1 != end && p[1] == '*') {
+            char const* close = std::search(p + 2, end, "*/", "*/" + 2);
+            if (close == end) {
+                p = end;
+                token.type = token_invalid;
+            } else {
+                p = close + 2;
+                token.type = token_comment;
+            }
+        } else {
+            token.type = token_invalid;
+            for (std::size_t i = 0; i < sizeof(two_char_punctuation) / sizeof(char const*); ++i) {
+                if (p + 1 != end && c == two_char_punctuation[i][0] && p[1] == two_char_punctuation[i][1]) {
+                    p += 2;
+                    token.type = token_punctuation;
+                    break;
+                }
+            }
+            if (token.type == token_invalid) {
+                if (is_punctuation(c)) token.type = token_punctuation;
+                ++p;
+            }
+        }
+
+        token.end = p - begin;
+        tokens.push_back(token);
+    }
+}
+
+bool token_is(std::string const& in, carto_token const& token, char const* s)
+{
+    std::size_t n = token.end - token.begin;
+    return std::strlen(s) == n && in.compare(token.begin, n, s) == 0;
+}
+
+}
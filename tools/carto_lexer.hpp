@@ -0,0 +1,64 @@
+#ifndef CARTO_LEXER_H
+#define CARTO_LEXER_H
+
+#include <string>
+#include <vector>
+
+#include <mapnik/color.hpp>
+
+#include <position_iterator.hpp>
+
+namespace carto {
+
+enum carto_token_type
+{
+    token_end,
+    token_number,           // 1  .5  2e3, signs are punctuation
+    token_dimension,        // 10%  2px
+    token_color,            // #fff  #a0b1c2
+    token_color_function,   // rgb(1, 2, 3)  rgba(0, 0, 0, 0.5)  rgb(10%, 0%, 0%)
+    token_string,           // 'a'  "a", quotes included
+    token_variable,         // @name
+    token_hash,             // #name that isn't a color
+    token_identifier,       // name  lighten  red
+    token_comment,          // /* ... */ with preserve_comments
+    token_punctuation,      // { } ( ) [ ] , ; : :: + - * / % . = == != <> < <= > >= ! && ||
+    token_invalid           // unterminated string or comment, @ without a name, other bytes
+};
+
+// One token of carto source. Tokens know where they start, which is where
+// the character grammar places annotations: at the first non-space
+// character after a construct, which is the next token.
+struct carto_token {
+    carto_token_type type;
+    std::size_t begin, end;
+    source_location location;
+
+    // numbers and the number part of dimensions
+    double number;
+
+    // colors, color functions and identifiers that are color names
+    mapnik::color color;
+    bool is_color;
+
+    carto_token()
+      : type(token_end), begin(0), end(0), location(), number(0), color(), is_color(false) { }
+};
+
+typedef std::vector<carto_token> carto_tokens;
+
+// Splits carto source into tokens in one pass, without backtracking over
+// characters. Whitespace and comments are skipped with scan_space, as the
+// grammars' skipper does; with preserve_comments /* */ comments are tokens
+// instead. Lines and columns count as position_iterator counts them. The
+// last token is always token_end, at the end of the source after trailing
+// whitespace. Malformed input is not an error here but a token_invalid
+// for whoever reads the tokens to report.
+void tokenize_carto(std::string const& in, carto_tokens& tokens, bool preserve_comments = false);
+
+// Whether the characters of a token are exactly s
+bool token_is(std::string const& in, carto_token const& token, char const* s);
+
+}
+
+#endif
@@ -0,0 +1,160 @@
+// Load test for carto --serve: a number of connections each sending the
+// same compile request a number of times, reporting requests per second
+// and latency percentiles. --inline sends the MML source with every
+// request instead of its path.
+//
+//   tools/compile_load_test socket map.mml [connections] [requests] [--inline]
+
+#include <parse_cache.hpp>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef boost::asio::local::stream_protocol protocol;
+
+struct client_result {
+    std::vector<double> latencies;
+    std::size_t errors;
+    std::string first_error;
+
+    client_result() : latencies(), errors(0), first_error() { }
+};
+
+static double elapsed_ms(boost::posix_time::ptime start)
+{
+    using namespace boost::posix_time;
+    return (microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+}
+
+// read one answer, returning the error message or an empty string
+static std::string read_answer(protocol::socket& socket, boost::asio::streambuf& buffer)
+{
+    std::istream in(&buffer);
+    std::string line, status;
+    std::size_t length = 0, warnings = 0;
+
+    boost::asio::read_until(socket, buffer, '\n');
+    std::getline(in, line);
+    std::istringstream header(line);
+    header >> status >> length >> warnings;
+
+    for (std::size_t i = 0; i < warnings; ++i) {
+        boost::asio::read_until(socket, buffer, '\n');
+        std::getline(in, line);
+    }
+
+    if (buffer.size() < length)
+        boost::asio::read(socket, buffer, boost::asio::transfer_at_least(length - buffer.size()));
+
+    std::string body(length, '\0');
+    if (length)
+        in.read(&body[0], length);
+
+    if (status == "ok") return "";
+    return body.empty() ? "malformed answer: " + line : body;
+}
+
+static void run_client(std::string const& socket_path, std::string const& request,
+                       std::size_t requests, client_result& result)
+{
+    using namespace boost::posix_time;
+
+    try {
+        boost::asio::io_service io;
+        protocol::socket socket(io);
+        socket.connect(protocol::endpoint(socket_path));
+        boost::asio::streambuf buffer;
+
+        for (std::size_t i = 0; i < requests; ++i) {
+            ptime start = microsec_clock::universal_time();
+
+            boost::asio::write(socket, boost::asio::buffer(request));
+            std::string error = read_answer(socket, buffer);
+
+            result.latencies.push_back(elapsed_ms(start));
+            if (!error.empty() && !result.errors++)
+                result.first_error = error;
+        }
+    } catch (std::exception& e) {
+        ++result.errors;
+        if (result.first_error.empty())
+            result.first_error = e.what();
+    }
+}
+
+static double percentile(std::vector<double> const& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    return sorted[static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5)];
+}
+
+int main(int argc, char **argv)
+{
+    using boost::lexical_cast;
+    using namespace boost::posix_time;
+
+    if (argc < 3) {
+        std::cout << "usage: compile_load_test socket map.mml [connections] [requests] [--inline]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string socket_path = argv[1],
+                mml_path = argv[2];
+    std::size_t connections = argc > 3 ? lexical_cast<std::size_t>(argv[3]) : 8,
+                requests = argc > 4 ? lexical_cast<std::size_t>(argv[4]) : 100;
+    bool send_inline = argc > 5 && std::string(argv[5]) == "--inline";
+
+    std::string request;
+    if (send_inline) {
+        std::string source = carto::read_source(mml_path);
+        request = "mml-source " + lexical_cast<std::string>(source.size()) + " " + mml_path + "\n" + source;
+    } else {
+        request = "mml " + mml_path + "\n";
+    }
+
+    std::vector<client_result> results(connections);
+    boost::thread_group clients;
+
+    ptime start = microsec_clock::universal_time();
+    for (std::size_t i = 0; i < connections; ++i)
+        clients.create_thread(boost::bind(&run_client, boost::cref(socket_path), boost::cref(request),
+                                          requests, boost::ref(results[i])));
+    clients.join_all();
+    double total_ms = elapsed_ms(start);
+
+    std::vector<double> latencies;
+    std::size_t errors = 0;
+    std::string first_error;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        latencies.insert(latencies.end(), results[i].latencies.begin(), results[i].latencies.end());
+        errors += results[i].errors;
+        if (first_error.empty())
+            first_error = results[i].first_error;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << connections << " connections x " << requests << " requests, "
+              << latencies.size() << " answered, " << errors << " errors\n"
+              << "throughput: " << (total_ms > 0 ? latencies.size() * 1000.0 / total_ms : 0) << " req/s\n"
+              << "latency ms: p50 " << percentile(latencies, 0.5)
+              << ", p90 " << percentile(latencies, 0.9)
+              << ", p99 " << percentile(latencies, 0.99)
+              << ", max " << (latencies.empty() ? 0 : latencies.back()) << "\n";
+
+    if (errors) {
+        std::cout << "first error: " << first_error << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
@@ -0,0 +1,392 @@
+// Parser throughput: parses every .mss file in the given directories with
+// the character grammar (carto_parser) a number of times over, and reports
+// MB/s, best of the runs, against splitting the same files into tokens
+// (tokenize_carto), which is as fast as any parser over them can get. The
+// lexer has to get through every file the grammar parses, with comments
+// and without, without an invalid token; a file where it doesn't fails
+// the run.
+//
+// Every .mml file is read the same way with json_parser and with read_mml.
+// The document read_mml gives is compared with the one the grammar's tree
+// describes, as mml_parser used to walk it: every member value and location,
+// the stylesheets and each layer's datasource.
+//
+//   tools/parser_throughput [-n runs] directory...
+//
+// Files the grammars reject are listed and left out of the numbers.
+
+#include "carto_lexer.hpp"
+
+#include <parse/parse_tree.hpp>
+#include <parse/carto_grammar.hpp>
+#include <parse/json_grammar.hpp>
+#include <parse/mml_reader.hpp>
+#include <parse_cache.hpp>
+#include <utility/utree.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+using boost::spirit::utree;
+
+typedef carto::position_iterator<std::string::const_iterator> iter;
+
+struct source_file {
+    std::string path;
+    std::string source;
+};
+
+static bool is_list(utree const& x)
+{
+    return x.which() == boost::spirit::utree_type::list_type;
+}
+
+// an object or array by its annotation, or the symbol the grammar gives
+// for an empty one
+static bool is_kind(carto::parse_tree const& tree, utree const& x, carto::node_type kind)
+{
+    if (is_list(x))
+        return x.tag() && tree.annotations(x.tag()).second == kind;
+    return x.which() == boost::spirit::utree_type::symbol_type &&
+           carto::detail::as<std::string>(x) == (kind == carto::json_object ? "{}" : "[]");
+}
+
+// objects and arrays among the values are only marked, as read_mml marks them
+static carto::mml_member tree_member(carto::parse_tree const& tree, utree const& pair)
+{
+    carto::mml_member member;
+    member.key = carto::detail::as<std::string>(pair.front());
+    member.value = is_list(pair.back()) ? utree(utree::list_type()) : pair.back();
+    member.value.tag(0);
+    member.location = tree.annotations(pair.tag()).first;
+    return member;
+}
+
+static carto::mml_layer tree_layer(carto::parse_tree const& tree, utree const& object)
+{
+    carto::mml_layer layer;
+    if (!is_list(object)) return layer;
+
+    utree const& pairs = object.front();
+    for (utree::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
+        carto::mml_member member = tree_member(tree, *it);
+        if (member.key != "Datasource") {
+            layer.members.push_back(member);
+            continue;
+        }
+
+        utree const& value = it->back();
+        if (!is_kind(tree, value, carto::json_object))
+            throw std::runtime_error("Datasource is not an object");
+        layer.has_datasource = true;
+        if (!is_list(value)) continue;
+
+        for (utree::const_iterator ds_it = value.front().begin(); ds_it != value.front().end(); ++ds_it)
+            layer.datasource.push_back(tree_member(tree, *ds_it));
+        layer.datasource_location = tree.annotations(value.tag()).first;
+    }
+    return layer;
+}
+
+// The document of a json_parser tree, as mml_parser used to walk it.
+// Throws where read_mml fails over what the grammar accepts: a root,
+// Stylesheet, Layer, layer or Datasource of the wrong kind.
+static carto::mml_document tree_document(carto::parse_tree const& tree)
+{
+    carto::mml_document doc;
+    if (!is_kind(tree, tree.ast(), carto::json_object))
+        throw std::runtime_error("the root is not an object");
+    if (!is_list(tree.ast())) return doc;
+
+    utree const& pairs = tree.ast().front();
+    for (utree::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
+        carto::mml_member member = tree_member(tree, *it);
+        utree const& value = it->back();
+
+        carto::mml_part part;
+        if (member.key == "Stylesheet" || member.key == "Layer") {
+            if (!is_kind(tree, value, carto::json_array))
+                throw std::runtime_error(member.key + " is not an array");
+
+            bool sheets = member.key == "Stylesheet";
+            part.type = sheets ? carto::mml_part::stylesheet : carto::mml_part::layer;
+            part.begin = part.end = sheets ? doc.stylesheets.size() : doc.layers.size();
+
+            // [] is a symbol, not an empty list
+            if (is_list(value)) {
+                for (utree::const_iterator v_it = value.begin(); v_it != value.end(); ++v_it) {
+                    if (sheets) {
+                        doc.stylesheets.push_back(carto::detail::as<std::string>(*v_it));
+                    } else if (is_kind(tree, *v_it, carto::json_object)) {
+                        doc.layers.push_back(tree_layer(tree, *v_it));
+                    } else {
+                        throw std::runtime_error("a layer is not an object");
+                    }
+                }
+            }
+            part.end = sheets ? doc.stylesheets.size() : doc.layers.size();
+        } else {
+            part.begin = doc.members.size();
+            part.end = part.begin + 1;
+            doc.members.push_back(member);
+        }
+        doc.parts.push_back(part);
+    }
+    return doc;
+}
+
+static bool same_members(std::vector<carto::mml_member> const& a, std::vector<carto::mml_member> const& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (a[i].key != b[i].key || a[i].value.which() != b[i].value.which() ||
+            !(a[i].location == b[i].location))
+            return false;
+        // nan is not equal to itself
+        if (!(a[i].value == b[i].value) &&
+            carto::detail::as<std::string>(a[i].value) != carto::detail::as<std::string>(b[i].value))
+            return false;
+    }
+    return true;
+}
+
+static bool same_document(carto::mml_document const& a, carto::mml_document const& b)
+{
+    if (!same_members(a.members, b.members) || a.stylesheets != b.stylesheets ||
+        a.layers.size() != b.layers.size() || a.parts.size() != b.parts.size())
+        return false;
+
+    for (std::size_t i = 0; i < a.parts.size(); ++i) {
+        if (a.parts[i].type != b.parts[i].type || a.parts[i].begin != b.parts[i].begin ||
+            a.parts[i].end != b.parts[i].end)
+            return false;
+    }
+
+    for (std::size_t i = 0; i < a.layers.size(); ++i) {
+        carto::mml_layer const& x = a.layers[i];
+        carto::mml_layer const& y = b.layers[i];
+        if (!same_members(x.members, y.members) || x.has_datasource != y.has_datasource ||
+            !same_members(x.datasource, y.datasource))
+            return false;
+        // an empty Datasource has no location in the tree
+        if (x.datasource_location.line != -1 && !(x.datasource_location == y.datasource_location))
+            return false;
+    }
+    return true;
+}
+
+static bool spirit_parse(source_file const& file, bool preserve_comments, carto::parse_tree& tree)
+{
+    try {
+        tree = carto::build_parse_tree< carto::carto_parser<iter> >(file.source, file.path, preserve_comments);
+        return true;
+    } catch (std::exception&) {
+        return false;
+    }
+}
+
+static bool json_parse(source_file const& file, carto::mml_document& doc)
+{
+    try {
+        doc = tree_document(carto::build_parse_tree< carto::json_parser<iter> >(file.source, file.path));
+        return true;
+    } catch (std::exception&) {
+        return false;
+    }
+}
+
+static bool mml_parse(source_file const& file, carto::mml_document& doc)
+{
+    try {
+        doc = carto::read_mml(file.source, file.path);
+        return true;
+    } catch (std::exception&) {
+        return false;
+    }
+}
+
+static double spirit_pass(std::vector<source_file> const& files)
+{
+    using namespace boost::posix_time;
+    ptime start = microsec_clock::universal_time();
+    for (std::size_t i = 0; i < files.size(); ++i)
+        carto::build_parse_tree< carto::carto_parser<iter> >(files[i].source, files[i].path);
+    return (microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+}
+
+static double lexer_pass(std::vector<source_file> const& files)
+{
+    using namespace boost::posix_time;
+    carto::carto_tokens tokens;
+    ptime start = microsec_clock::universal_time();
+    for (std::size_t i = 0; i < files.size(); ++i)
+        carto::tokenize_carto(files[i].source, tokens);
+    return (microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+}
+
+static double json_pass(std::vector<source_file> const& files)
+{
+    using namespace boost::posix_time;
+    ptime start = microsec_clock::universal_time();
+    for (std::size_t i = 0; i < files.size(); ++i)
+        carto::build_parse_tree< carto::json_parser<iter> >(files[i].source, files[i].path);
+    return (microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+}
+
+static double mml_pass(std::vector<source_file> const& files)
+{
+    using namespace boost::posix_time;
+    ptime start = microsec_clock::universal_time();
+    for (std::size_t i = 0; i < files.size(); ++i)
+        carto::read_mml(files[i].source, files[i].path);
+    return (microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+}
+
+// best of the runs, in MB/s
+static double throughput(double (*pass)(std::vector<source_file> const&),
+                         std::vector<source_file> const& files, double bytes, unsigned runs)
+{
+    double best = 0;
+    for (unsigned r = 0; r < runs; ++r) {
+        double seconds = pass(files);
+        best = r ? std::min(best, seconds) : seconds;
+    }
+    return best > 0 ? bytes / (1024 * 1024) / best : 0;
+}
+
+// whether tokenize_carto gets through the file without an invalid token
+static bool lexes(source_file const& file, bool preserve_comments)
+{
+    carto::carto_tokens tokens;
+    carto::tokenize_carto(file.source, tokens, preserve_comments);
+    for (carto::carto_tokens::const_iterator it = tokens.begin(); it != tokens.end(); ++it) {
+        if (it->type == carto::token_invalid)
+            return false;
+    }
+    return true;
+}
+
+// false, and says why, when the lexer rejects what the grammar parses;
+// accepted is whether the grammar parses the file without comments
+static bool check_mss(source_file const& file, bool& accepted)
+{
+    for (int preserve = 0; preserve < 2; ++preserve) {
+        carto::parse_tree tree;
+        bool ok = spirit_parse(file, preserve, tree);
+
+        if (ok && !lexes(file, preserve)) {
+            std::cout << "FAIL  " << file.path << ": the lexer rejects what the grammar parses"
+                      << (preserve ? " with comments" : "") << "\n";
+            return false;
+        }
+        // timed as compiled, without comments
+        if (!preserve) accepted = ok;
+    }
+    return true;
+}
+
+static bool check_mml(source_file const& file, bool& accepted)
+{
+    carto::mml_document json_doc, mml_doc;
+    bool json_ok = json_parse(file, json_doc),
+         mml_ok = mml_parse(file, mml_doc);
+
+    if (json_ok != mml_ok) {
+        std::cout << "FAIL  " << file.path << ": only "
+                  << (json_ok ? "json_parser" : "read_mml") << " parses it\n";
+        return false;
+    }
+    if (json_ok && !same_document(json_doc, mml_doc)) {
+        std::cout << "FAIL  " << file.path << ": the documents differ\n";
+        return false;
+    }
+    accepted = json_ok;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned runs = 20;
+    std::vector<std::string> directories;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc)
+            runs = boost::lexical_cast<unsigned>(argv[++i]);
+        else
+            directories.push_back(arg);
+    }
+
+    if (directories.empty() || runs == 0) {
+        std::cout << "usage: parser_throughput [-n runs] directory...\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<source_file> files, mml_files;
+    std::size_t failed = 0, rejected = 0;
+    double bytes = 0, mml_bytes = 0;
+
+    for (std::size_t d = 0; d < directories.size(); ++d) {
+        std::vector<std::string> paths;
+        for (fs::directory_iterator it(directories[d]); it != fs::directory_iterator(); ++it) {
+            if (it->path().extension() == ".mss" || it->path().extension() == ".mml")
+                paths.push_back(it->path().string());
+        }
+        std::sort(paths.begin(), paths.end());
+
+        for (std::size_t i = 0; i < paths.size(); ++i) {
+            source_file file;
+            file.path = paths[i];
+            file.source = carto::read_source(file.path);
+
+            bool mml = fs::path(file.path).extension() == ".mml", accepted = false;
+            if (!(mml ? check_mml(file, accepted) : check_mss(file, accepted))) {
+                ++failed;
+            } else if (!accepted) {
+                ++rejected;
+                std::cout << "rejected  " << file.path << "\n";
+            } else if (mml) {
+                mml_bytes += file.source.size();
+                mml_files.push_back(file);
+            } else {
+                bytes += file.source.size();
+                files.push_back(file);
+            }
+        }
+    }
+
+    double spirit = throughput(spirit_pass, files, bytes, runs),
+           lexer = throughput(lexer_pass, files, bytes, runs),
+           json = throughput(json_pass, mml_files, mml_bytes, runs),
+           reader = throughput(mml_pass, mml_files, mml_bytes, runs);
+
+    std::cout << files.size() << " files, " << static_cast<std::size_t>(bytes) / 1024 << " KB, best of "
+              << runs << " runs\n"
+              << std::fixed << std::setprecision(2)
+              << "  carto_parser      " << std::setw(10) << spirit << " MB/s\n"
+              << "  tokenize_carto    " << std::setw(10) << lexer << " MB/s";
+    if (spirit > 0)
+        std::cout << " (" << std::setprecision(1) << lexer / spirit << "x)" << std::setprecision(2);
+    std::cout << "\n"
+              << mml_files.size() << " MML files, " << static_cast<std::size_t>(mml_bytes) / 1024 << " KB\n"
+              << "  json_parser       " << std::setw(10) << json << " MB/s\n"
+              << "  read_mml          " << std::setw(10) << reader << " MB/s";
+    if (json > 0)
+        std::cout << " (" << std::setprecision(1) << reader / json << "x)" << std::setprecision(2);
+    std::cout << "\n"
+              << failed << " files failed, " << rejected << " rejected\n";
+
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,377 @@
+// Golden output regression runner: compiles every .mml in a directory,
+// several at once, and compares the Mapnik XML with the .result file next
+// to it after normalizing both (attribute order, whitespace, CDATA, number
+// formatting, absolute datasource paths). Reports the compile time of each
+// test, best of a number of runs, and flags tests that got slower than a
+// stored baseline by more than a threshold.
+//
+// Tests compile with lazy datasources and carto's defaults otherwise. A
+// <name>.options file next to the .mml lists carto flags to compile that
+// test with instead, e.g. --merge-zooms or --profile-data=4000; tests
+// whose flags read the data run one after the other once the rest are
+// done.
+//
+//   tools/regression_test [-j jobs] [-n runs] [--threshold percent]
+//                         [--baseline file] [--update-baseline] directory
+//
+// Exits with failure when any output differs or a compile fails. Slower
+// tests are only flagged. Timings taken with -j 1 are the most stable.
+
+#include <compiler.hpp>
+#include <parse_cache.hpp>
+#include <utility/thread_pool.hpp>
+
+#include <mapnik/save_map.hpp>
+#include <mapnik/datasource_cache.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace pt = boost::property_tree;
+
+struct test_result {
+    std::string name;
+    std::string mml;
+    carto::compile_options options;
+    std::string error;
+    std::string difference;
+    double ms;
+
+    // compiled and compared; a test that didn't get there without an error
+    // failed all the same
+    bool ran;
+
+    test_result() : name(), mml(), options(), error(), difference(), ms(0), ran(false) { }
+};
+
+// the N of a --flag[=N] sample size, 1000 as carto's default
+static std::size_t sample_size(std::string const& value, std::string const& file)
+{
+    if (value.empty()) return 1000;
+
+    try {
+        return boost::lexical_cast<std::size_t>(value);
+    } catch (boost::bad_lexical_cast&) {
+        throw std::runtime_error("bad sample size " + value + " in " + file);
+    }
+}
+
+// the carto flags listed in file, whitespace separated
+static void read_options(std::string const& file, carto::compile_options& options)
+{
+    std::ifstream in(file.c_str());
+    if (!in.is_open())
+        throw std::runtime_error("could not read " + file);
+
+    std::string word;
+    while (in >> word) {
+        std::string::size_type eq = word.find('=');
+        std::string flag = word.substr(0, eq),
+                    value = eq == std::string::npos ? "" : word.substr(eq + 1);
+
+        if (flag == "--sample-filters")
+            options.sample_limit = sample_size(value, file);
+        else if (flag == "--profile-data")
+            options.profile_limit = sample_size(value, file);
+        else if (eq != std::string::npos)
+            throw std::runtime_error("unknown option " + word + " in " + file);
+        else if (flag == "--infer-layer-zooms")
+            options.infer_zooms = true;
+        else if (flag == "--project-columns")
+            options.project_columns = true;
+        else if (flag == "--prune-rules")
+            options.prune_rules = true;
+        else if (flag == "--merge-zooms")
+            options.merge_zooms = true;
+        else if (flag == "--fold-values")
+            options.fold_values = true;
+        else if (flag == "--share-styles")
+            options.share_styles = true;
+        else if (flag == "--order-filters")
+            options.order_filters = true;
+        else
+            throw std::runtime_error("unknown option " + word + " in " + file);
+    }
+}
+
+// datasource plugins aren't safe to create from several threads at once
+static bool reads_data(carto::compile_options const& options)
+{
+    return options.project_columns || options.sample_limit || options.profile_limit;
+}
+
+// a number in any notation compares equal to itself
+static std::string normalize_value(std::string value)
+{
+    boost::algorithm::trim(value);
+
+    std::string collapsed;
+    bool space = false;
+    for (std::string::const_iterator it = value.begin(); it != value.end(); ++it) {
+        bool is_space = *it == ' ' || *it == '\t' || *it == '\n' || *it == '\r';
+        if (!is_space) {
+            if (space) collapsed += ' ';
+            collapsed += *it;
+        }
+        space = is_space;
+    }
+
+    try {
+        return boost::lexical_cast<std::string>(boost::lexical_cast<double>(collapsed));
+    } catch (boost::bad_lexical_cast&) {
+        return collapsed;
+    }
+}
+
+// one line per element, attributes sorted, indented by depth
+static void normalize_node(std::ostream& out, std::string const& name, pt::ptree const& node,
+                           std::string const& indent)
+{
+    std::map<std::string, std::string> attrs;
+    pt::ptree::const_assoc_iterator attr_it = node.find("<xmlattr>");
+    if (attr_it != node.not_found()) {
+        for (pt::ptree::const_iterator it = attr_it->second.begin(); it != attr_it->second.end(); ++it)
+            attrs[it->first] = normalize_value(it->second.data());
+    }
+
+    std::string text = normalize_value(node.data());
+
+    // file names are written absolute, golden files have a placeholder
+    if (name == "Parameter" && (attrs["name"] == "file" || attrs["name"] == "base"))
+        text = "[absolute path]";
+
+    out << indent << name;
+    for (std::map<std::string, std::string>::const_iterator it = attrs.begin(); it != attrs.end(); ++it)
+        out << " " << it->first << "=\"" << it->second << "\"";
+    if (!text.empty())
+        out << " : " << text;
+    out << "\n";
+
+    for (pt::ptree::const_iterator it = node.begin(); it != node.end(); ++it) {
+        if (it->first == "<xmlattr>" || it->first == "<xmlcomment>") continue;
+        normalize_node(out, it->first, it->second, indent + "  ");
+    }
+}
+
+static std::string normalize_xml(std::string const& xml)
+{
+    std::istringstream in(xml);
+    pt::ptree tree;
+    pt::read_xml(in, tree, pt::xml_parser::trim_whitespace | pt::xml_parser::no_comments);
+
+    std::ostringstream out;
+    for (pt::ptree::const_iterator it = tree.begin(); it != tree.end(); ++it)
+        normalize_node(out, it->first, it->second, "");
+    return out.str();
+}
+
+// the first line where the normalized forms differ, or an empty string
+static std::string first_difference(std::string const& expected, std::string const& actual)
+{
+    std::istringstream expected_in(expected), actual_in(actual);
+    std::string expected_line, actual_line;
+
+    for (std::size_t line = 1; ; ++line) {
+        bool more_expected = !!std::getline(expected_in, expected_line),
+             more_actual = !!std::getline(actual_in, actual_line);
+
+        if (!more_expected && !more_actual) return "";
+        if (!more_expected) expected_line = "(end)";
+        if (!more_actual) actual_line = "(end)";
+
+        if (!more_expected || !more_actual || expected_line != actual_line) {
+            boost::algorithm::trim(expected_line);
+            boost::algorithm::trim(actual_line);
+            return "element " + boost::lexical_cast<std::string>(line) + ": expected " +
+                   expected_line + "\n      got      " + actual_line;
+        }
+    }
+}
+
+static void run_test(test_result& result, unsigned runs)
+{
+    using namespace boost::posix_time;
+
+    if (!result.error.empty()) return;
+
+    try {
+        std::string source = carto::read_source(result.mml);
+        std::string xml;
+
+        for (unsigned r = 0; r < runs; ++r) {
+            ptime start = microsec_clock::universal_time();
+            carto::compile_result compiled = carto::compile_mml(source, result.mml, result.options);
+            xml = mapnik::save_map_to_string(compiled.map, false);
+            double ms = (microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+
+            result.ms = r ? std::min(result.ms, ms) : ms;
+        }
+
+        std::string expected = carto::read_source(fs::path(result.mml).replace_extension(".result").string());
+        result.difference = first_difference(normalize_xml(expected), normalize_xml(xml));
+        result.ran = true;
+    } catch (std::exception& e) {
+        result.error = e.what();
+    } catch (...) {
+        result.error = "Unknown error";
+    }
+}
+
+static bool by_name(test_result const* a, test_result const* b)
+{
+    return a->name < b->name;
+}
+
+static std::map<std::string, double> read_baseline(std::string const& file)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream in(file.c_str());
+
+    std::string name;
+    double ms;
+    while (in >> name >> ms)
+        baseline[name] = ms;
+
+    return baseline;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned jobs = 0, runs = 3;
+    double threshold = 50;
+    bool update_baseline = false;
+    std::string baseline_file, directory;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            jobs = boost::lexical_cast<unsigned>(argv[++i]);
+        else if (arg == "-n" && i + 1 < argc)
+            runs = boost::lexical_cast<unsigned>(argv[++i]);
+        else if (arg == "--threshold" && i + 1 < argc)
+            threshold = boost::lexical_cast<double>(argv[++i]);
+        else if (arg == "--baseline" && i + 1 < argc)
+            baseline_file = argv[++i];
+        else if (arg == "--update-baseline")
+            update_baseline = true;
+        else
+            directory = arg;
+    }
+
+    if (directory.empty() || runs == 0 || (update_baseline && baseline_file.empty())) {
+        std::cout << "usage: regression_test [-j jobs] [-n runs] [--threshold percent]\n"
+                  << "                       [--baseline file] [--update-baseline] directory\n";
+        return EXIT_FAILURE;
+    }
+
+    mapnik::datasource_cache::instance()->register_datasources(MAPNIKDIR);
+
+    std::vector<test_result> results;
+    for (fs::directory_iterator it(directory); it != fs::directory_iterator(); ++it) {
+        if (it->path().extension() != ".mml") continue;
+
+        test_result result;
+        result.name = it->path().stem().string();
+        result.mml = it->path().string();
+        result.options.lazy_datasources = true;
+
+        fs::path options_file = fs::path(result.mml).replace_extension(".options");
+        if (fs::exists(options_file)) {
+            try {
+                read_options(options_file.string(), result.options);
+            } catch (std::exception& e) {
+                result.error = e.what();
+            }
+        }
+
+        results.push_back(result);
+    }
+
+    {
+        carto::thread_pool pool(jobs);
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            if (!reads_data(results[i].options))
+                pool.submit(boost::bind(&run_test, boost::ref(results[i]), runs));
+        }
+        pool.wait();
+    }
+
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        if (reads_data(results[i].options))
+            run_test(results[i], runs);
+    }
+
+    std::map<std::string, double> baseline;
+    if (!baseline_file.empty() && !update_baseline)
+        baseline = read_baseline(baseline_file);
+
+    std::vector<test_result*> sorted;
+    for (std::size_t i = 0; i < results.size(); ++i)
+        sorted.push_back(&results[i]);
+    std::sort(sorted.begin(), sorted.end(), by_name);
+
+    std::size_t failed = 0, slower = 0;
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        test_result const& result = *sorted[i];
+
+        if (!result.error.empty() || !result.ran) {
+            ++failed;
+            std::cout << "ERROR " << result.name << ": "
+                      << (result.error.empty() ? "did not run to the end" : result.error) << "\n";
+            continue;
+        }
+
+        std::cout << (result.difference.empty() ? "ok    " : "FAIL  ") << result.name
+                  << " (" << result.ms << " ms";
+
+        std::map<std::string, double>::const_iterator base = baseline.find(result.name);
+        if (base != baseline.end()) {
+            double change = base->second > 0 ? (result.ms - base->second) * 100 / base->second : 0;
+            std::cout << ", baseline " << base->second << " ms";
+            // differences under half a millisecond are noise
+            if (change > threshold && result.ms - base->second > 0.5) {
+                ++slower;
+                std::cout << ", SLOWER by " << static_cast<int>(change) << "%";
+            }
+        }
+        std::cout << ")\n";
+
+        if (!result.difference.empty()) {
+            ++failed;
+            std::cout << "      " << result.difference << "\n";
+        }
+    }
+
+    std::cout << sorted.size() << " tests, " << failed << " failed, "
+              << slower << " slower than the baseline by more than " << threshold << "%\n";
+
+    if (update_baseline) {
+        std::ofstream out(baseline_file.c_str());
+        if (!out.is_open()) {
+            std::cout << "Error: could not write " << baseline_file << "\n";
+            return EXIT_FAILURE;
+        }
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            if (sorted[i]->ran)
+                out << sorted[i]->name << "\t" << sorted[i]->ms << "\n";
+        }
+    }
+
+    return failed ? EXIT_FAILURE : 0;
+}
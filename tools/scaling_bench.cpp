@@ -0,0 +1,248 @@
+// Scaling benchmark: generates synthetic projects of growing numbers of
+// layers with tools/synthetic_project, compiles each with carto in a child
+// process and records wall time (best of the runs) and peak RSS against
+// project size. Writes the numbers as tab separated values to output.tsv
+// and plots them to output.svg.
+//
+//   tools/scaling_bench [-n runs] generator carto output layers... [-- generator options]
+//
+// Compiles use --lazy-datasources, the generated layers have no data.
+// The projects are written to a temporary directory that is removed
+// again however the benchmark ends.
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+struct sample {
+    unsigned layers;
+    boost::uintmax_t bytes;
+    double ms;
+    long rss_kb;
+
+    sample() : layers(0), bytes(0), ms(0), rss_kb(0) { }
+};
+
+// run a program to completion, raising rss_kb to its peak RSS in kilobytes
+static bool run(std::vector<std::string> const& args, long& rss_kb)
+{
+    std::vector<char*> argv;
+    for (std::size_t i = 0; i < args.size(); ++i)
+        argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(0);
+
+    // or the child's freopen writes out what is buffered here
+    std::cout.flush();
+    std::fflush(0);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+
+    if (pid == 0) {
+        // the compiler's own output isn't wanted
+        if (!freopen("/dev/null", "w", stdout) || !freopen("/dev/null", "w", stderr))
+            _exit(127);
+        execv(argv[0], &argv[0]);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid)
+        return false;
+
+    rss_kb = std::max(rss_kb, usage.ru_maxrss);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// removes a directory and everything in it when going out of scope
+struct remove_on_exit {
+    fs::path dir;
+
+    explicit remove_on_exit(fs::path const& dir_) : dir(dir_) { }
+
+    ~remove_on_exit()
+    {
+        boost::system::error_code ignored;
+        fs::remove_all(dir, ignored);
+    }
+};
+
+// a new, empty directory under $TMPDIR or /tmp
+static fs::path make_work_directory()
+{
+    char const* tmp = std::getenv("TMPDIR");
+    std::string pattern = std::string(tmp && *tmp ? tmp : "/tmp") + "/carto-scaling-XXXXXX";
+
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back(0);
+    if (!mkdtemp(&name[0]))
+        return fs::path();
+    return fs::path(&name[0]);
+}
+
+static std::string absolute_path(std::string const& file)
+{
+#if (BOOST_FILESYSTEM_VERSION == 3)
+    return fs::absolute(file).string();
+#else // v2
+    return fs::complete(file).string();
+#endif
+}
+
+static boost::uintmax_t project_bytes(fs::path const& dir)
+{
+    boost::uintmax_t bytes = 0;
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it)
+        bytes += fs::file_size(it->path());
+    return bytes;
+}
+
+// one polyline of a value of the samples against layers, in a w x h panel
+static void plot_panel(std::ostream& out, std::vector<sample> const& samples, bool rss,
+                       int left, int top, int w, int h, std::string const& title)
+{
+    unsigned max_layers = 1;
+    double max_value = 1e-9;
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        max_layers = std::max(max_layers, samples[i].layers);
+        max_value = std::max(max_value, rss ? samples[i].rss_kb / 1024.0 : samples[i].ms);
+    }
+
+    out << "<g transform=\"translate(" << left << "," << top << ")\">\n"
+        << "<text x=\"0\" y=\"-10\" font-size=\"14\">" << title << "</text>\n"
+        << "<line x1=\"0\" y1=\"" << h << "\" x2=\"" << w << "\" y2=\"" << h << "\" stroke=\"black\"/>\n"
+        << "<line x1=\"0\" y1=\"0\" x2=\"0\" y2=\"" << h << "\" stroke=\"black\"/>\n"
+        << "<text x=\"" << w << "\" y=\"" << h + 16 << "\" font-size=\"11\" text-anchor=\"end\">"
+        << max_layers << " layers</text>\n"
+        << "<text x=\"-4\" y=\"10\" font-size=\"11\" text-anchor=\"end\">" << max_value << "</text>\n"
+        << "<polyline fill=\"none\" stroke=\"steelblue\" stroke-width=\"2\" points=\"";
+
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        double value = rss ? samples[i].rss_kb / 1024.0 : samples[i].ms;
+        out << (i ? " " : "") << w * samples[i].layers / max_layers << ","
+            << h - h * value / max_value;
+    }
+    out << "\"/>\n</g>\n";
+}
+
+static void write_svg(std::ostream& out, std::vector<sample> const& samples)
+{
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"900\" height=\"360\" font-family=\"sans-serif\">\n";
+    plot_panel(out, samples, false, 70, 40, 340, 260, "compile time (ms)");
+    plot_panel(out, samples, true, 520, 40, 340, 260, "peak RSS (MB)");
+    out << "</svg>\n";
+}
+
+int main(int argc, char **argv)
+{
+    unsigned runs = 3;
+    std::vector<std::string> args, generator_options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc)
+            runs = boost::lexical_cast<unsigned>(argv[++i]);
+        else if (arg == "--") {
+            generator_options.assign(argv + i + 1, argv + argc);
+            break;
+        } else
+            args.push_back(arg);
+    }
+
+    if (args.size() < 4 || runs == 0) {
+        std::cout << "usage: scaling_bench [-n runs] generator carto output layers... [-- generator options]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string generator = absolute_path(args[0]),
+                carto = absolute_path(args[1]),
+                output = args[2];
+
+    std::vector<sample> samples(args.size() - 3);
+    for (std::size_t i = 3; i < args.size(); ++i) {
+        try {
+            samples[i - 3].layers = boost::lexical_cast<unsigned>(args[i]);
+        } catch (boost::bad_lexical_cast&) {
+            std::cout << "Error: not a number of layers: " << args[i] << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    fs::path work = make_work_directory();
+    if (work.empty()) {
+        std::cout << "Error: could not create a temporary directory\n";
+        return EXIT_FAILURE;
+    }
+    remove_on_exit cleanup(work);
+
+    for (std::size_t i = 3; i < args.size(); ++i) {
+        sample& s = samples[i - 3];
+
+        fs::path dir = work / args[i];
+        std::vector<std::string> generate;
+        generate.push_back(generator);
+        generate.push_back("--layers");
+        generate.push_back(args[i]);
+        generate.insert(generate.end(), generator_options.begin(), generator_options.end());
+        generate.push_back(dir.string());
+
+        long ignored = 0;
+        if (!run(generate, ignored)) {
+            std::cout << "Error: could not generate " << dir.string() << "\n";
+            return EXIT_FAILURE;
+        }
+        s.bytes = project_bytes(dir);
+
+        std::vector<std::string> compile;
+        compile.push_back(carto);
+        compile.push_back("--lazy-datasources");
+        compile.push_back((dir / "project.mml").string());
+        compile.push_back((dir / "project.xml").string());
+
+        for (unsigned r = 0; r < runs; ++r) {
+            using namespace boost::posix_time;
+            ptime start = microsec_clock::universal_time();
+            if (!run(compile, s.rss_kb)) {
+                std::cout << "Error: carto failed on " << dir.string() << "\n";
+                return EXIT_FAILURE;
+            }
+            double ms = (microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+            s.ms = r ? std::min(s.ms, ms) : ms;
+        }
+
+        std::cout << s.layers << " layers, " << s.bytes / 1024 << " KB: "
+                  << s.ms << " ms, " << s.rss_kb / 1024 << " MB peak RSS\n";
+    }
+
+    std::ofstream tsv((output + ".tsv").c_str());
+    std::ofstream svg((output + ".svg").c_str());
+    if (!tsv.is_open() || !svg.is_open()) {
+        std::cout << "Error: could not write " << output << ".tsv or .svg\n";
+        return EXIT_FAILURE;
+    }
+
+    tsv << "layers\tbytes\tms\trss_kb\n";
+    for (std::size_t i = 0; i < samples.size(); ++i)
+        tsv << samples[i].layers << "\t" << samples[i].bytes << "\t"
+            << samples[i].ms << "\t" << samples[i].rss_kb << "\n";
+
+    write_svg(svg, samples);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Layer to style matching benchmark: the selector-by-selector scan
+// mml_parser::parse_map used to do against the style_index lookup, over a
+// generated map of (by default) 1000 layers and 5000 styles.
+//
+//   tools/style_match_bench [layers] [styles] [classes]
+
+#include <style_index.hpp>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <cstdlib>
+#include <set>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef std::vector<std::string> selectors_type;
+typedef std::vector< std::vector<std::size_t> > matches_type;
+
+// the matching loop from parse_map before style_index
+static matches_type scan_match(std::vector<selectors_type> const& layers,
+                               std::vector<std::string> const& styles)
+{
+    std::vector<selectors_type> style_selectors;
+    for (std::size_t s = 0; s < styles.size(); ++s)
+        style_selectors.push_back(carto::style_index::selectors(styles[s]));
+
+    matches_type matches(layers.size());
+
+    for (std::size_t i = 0; i < layers.size(); ++i) {
+        for (std::size_t s = 0; s < style_selectors.size(); ++s) {
+            selectors_type::const_iterator lselect_it  = layers[i].begin(),
+                                           lselect_end = layers[i].end(),
+                                           sselect_it  = style_selectors[s].begin(),
+                                           sselect_end = style_selectors[s].end();
+
+            for(; lselect_it != lselect_end; ++lselect_it) {
+                while(sselect_it != sselect_end && *lselect_it != *sselect_it) {
+                    ++sselect_it;
+                }
+
+                if (sselect_it == sselect_end) break;
+            }
+
+            if (lselect_it == lselect_end && sselect_it != sselect_end)
+                matches[i].push_back(s);
+        }
+    }
+
+    return matches;
+}
+
+static matches_type index_match(std::vector<selectors_type> const& layers,
+                                std::vector<std::string> const& styles)
+{
+    carto::style_index index;
+    for (std::size_t s = 0; s < styles.size(); ++s)
+        index.add_style(styles[s]);
+
+    matches_type matches(layers.size());
+    for (std::size_t i = 0; i < layers.size(); ++i)
+        matches[i] = index.match(layers[i]);
+
+    return matches;
+}
+
+static double elapsed_ms(boost::posix_time::ptime start)
+{
+    using namespace boost::posix_time;
+    return (microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    using boost::lexical_cast;
+    using namespace boost::posix_time;
+
+    std::size_t n_layers  = argc > 1 ? lexical_cast<std::size_t>(argv[1]) : 1000,
+                n_styles  = argc > 2 ? lexical_cast<std::size_t>(argv[2]) : 5000,
+                n_classes = argc > 3 ? lexical_cast<std::size_t>(argv[3]) : 50;
+
+    std::srand(42);
+
+    // layers get an id, or one or two classes (kept in name order, so both
+    // matchers agree on the order-sensitive cases too)
+    std::vector<selectors_type> layers;
+    for (std::size_t i = 0; i < n_layers; ++i) {
+        selectors_type sel;
+        if (i % 3 == 0) {
+            sel.push_back("#layer" + lexical_cast<std::string>(i));
+        } else {
+            std::size_t a = std::rand() % n_classes, b = std::rand() % n_classes;
+            if (b < a) std::swap(a, b);
+            sel.push_back("class" + lexical_cast<std::string>(a));
+            if (i % 3 == 2 && a != b)
+                sel.push_back("class" + lexical_cast<std::string>(b));
+        }
+        layers.push_back(sel);
+    }
+
+    std::vector<std::string> styles;
+    std::set<std::string> seen;
+    for (std::size_t s = 0; styles.size() < n_styles; ++s) {
+        std::string name;
+        if (s % 2 == 0) {
+            name = "#layer" + lexical_cast<std::string>(std::rand() % n_layers);
+        } else {
+            std::size_t a = std::rand() % n_classes, b = std::rand() % n_classes;
+            if (b < a) std::swap(a, b);
+            name = ".class" + lexical_cast<std::string>(a)
+                 + ".class" + lexical_cast<std::string>(b);
+        }
+
+        // style names are unique in a map, repeats become attachments
+        if (s % 5 == 0 || seen.count(name))
+            name += "::attachment" + lexical_cast<std::string>(s);
+
+        seen.insert(name);
+        styles.push_back(name);
+    }
+
+    ptime start = microsec_clock::universal_time();
+    matches_type scanned = scan_match(layers, styles);
+    double scan_ms = elapsed_ms(start);
+
+    start = microsec_clock::universal_time();
+    matches_type indexed = index_match(layers, styles);
+    double index_ms = elapsed_ms(start);
+
+    std::size_t assigned = 0;
+    for (std::size_t i = 0; i < indexed.size(); ++i)
+        assigned += indexed[i].size();
+
+    std::cout << n_layers << " layers x " << n_styles << " styles, "
+              << assigned << " style assignments\n"
+              << "scan:  " << scan_ms << " ms\n"
+              << "index: " << index_ms << " ms\n";
+
+    if (scanned != indexed) {
+        std::cout << "MISMATCH between scan and index results\n";
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
@@ -0,0 +1,288 @@
+// Synthetic project generator for scaling tests: writes an MML project and
+// its stylesheets with a given number of layers and rules per layer, so
+// the compiler can be run at sizes far beyond the test corpus.
+//
+//   tools/synthetic_project [options] directory
+//
+//   --layers N        layers in the MML (100)
+//   --rules M         rule blocks per layer (10)
+//   --depth D         levels of nested blocks in every rule block (2)
+//   --zooms Z         distinct zoom levels filtered on, 0 for none (10)
+//   --variables P     percentage of values given through @variables (25)
+//   --expression K    operators or color functions per value, 0 for literals (1)
+//   --cardinality C   distinct values of the [kind] attribute filters, 0 for none (8)
+//   --stylesheets S   stylesheets the rules are spread over (1)
+//   --classes L       layer classes matched by class rules (8)
+//   --seed X          random seed (1)
+//
+// The same options and seed always write the same project. Layers point at
+// shapefiles that don't exist, compile with --lazy-datasources.
+
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+struct project_options {
+    unsigned layers;
+    unsigned rules;
+    unsigned depth;
+    unsigned zooms;
+    unsigned variables;
+    unsigned expression;
+    unsigned cardinality;
+    unsigned stylesheets;
+    unsigned classes;
+    unsigned seed;
+
+    project_options()
+      : layers(100), rules(10), depth(2), zooms(10), variables(25),
+        expression(1), cardinality(8), stylesheets(1), classes(8), seed(1) { }
+};
+
+// small deterministic generator, the same on every platform
+class random_source {
+public:
+    explicit random_source(unsigned seed) : state_(seed * 2654435761u + 1) { }
+
+    unsigned operator()(unsigned n)
+    {
+        state_ = state_ * 1103515245u + 12345u;
+        return n ? (state_ >> 8) % n : 0;
+    }
+
+    bool percent(unsigned p)
+    {
+        return (*this)(100) < p;
+    }
+
+private:
+    unsigned state_;
+};
+
+class stylesheet_writer {
+public:
+    stylesheet_writer(project_options const& options, random_source& random)
+      : options_(options), random_(random), variables_(), next_variable_(0) { }
+
+    // a rule block for a selector, nested depth levels deep
+    void write_block(std::ostream& out, std::string const& selector, unsigned depth, std::string const& indent)
+    {
+        out << indent << selector << " {\n";
+        write_properties(out, indent + "  ");
+
+        for (unsigned d = 0; d < depth; ++d) {
+            std::string filters = nested_filters();
+            if (filters.empty()) break;
+            write_block(out, filters, depth - d - 1, indent + "  ");
+        }
+
+        out << indent << "}\n";
+    }
+
+    // definitions of every variable the written blocks used
+    std::string const& variables() const
+    {
+        return variables_;
+    }
+
+private:
+    std::string nested_filters()
+    {
+        std::ostringstream out;
+        if (options_.zooms)
+            out << "[zoom " << (random_(2) ? ">=" : "<=") << " " << random_(options_.zooms) << "]";
+        if (options_.cardinality && random_(2))
+            out << "[kind='k" << random_(options_.cardinality) << "']";
+        return out.str();
+    }
+
+    void write_properties(std::ostream& out, std::string const& indent)
+    {
+        switch (random_(3)) {
+            case 0:
+                out << indent << "polygon-fill: " << value(color()) << ";\n"
+                    << indent << "polygon-opacity: " << value(number(1)) << ";\n";
+                break;
+            case 1:
+                out << indent << "line-color: " << value(color()) << ";\n"
+                    << indent << "line-width: " << value(number(8)) << ";\n";
+                break;
+            default:
+                out << indent << "marker-fill: " << value(color()) << ";\n"
+                    << indent << "marker-width: " << value(number(16)) << ";\n";
+                break;
+        }
+    }
+
+    // the value itself or a variable defined as it
+    std::string value(std::string const& literal)
+    {
+        if (!random_.percent(options_.variables))
+            return literal;
+
+        std::string name = "@v" + boost::lexical_cast<std::string>(next_variable_++);
+        variables_ += name + ": " + literal + ";\n";
+        return name;
+    }
+
+    std::string color()
+    {
+        static char const hex[] = "0123456789abcdef";
+
+        std::string result = "#";
+        for (int i = 0; i < 6; ++i)
+            result += hex[random_(16)];
+
+        static char const* const functions[] = { "lighten", "darken", "saturate", "desaturate" };
+        for (unsigned k = 0; k < options_.expression; ++k)
+            result = std::string(functions[random_(4)]) + "(" + result + ", " +
+                     boost::lexical_cast<std::string>(random_(20) + 1) + "%)";
+        return result;
+    }
+
+    std::string number(unsigned scale)
+    {
+        std::string result = tenths(random_(scale * 10) + 1);
+        for (unsigned k = 0; k < options_.expression; ++k)
+            result += (random_(2) ? " + " : " * ") + tenths(random_(10) + 1);
+        return result;
+    }
+
+    static std::string tenths(unsigned n)
+    {
+        return boost::lexical_cast<std::string>(n / 10) + "." + boost::lexical_cast<std::string>(n % 10);
+    }
+
+    project_options const& options_;
+    random_source& random_;
+    std::string variables_;
+    unsigned next_variable_;
+};
+
+static std::string layer_name(unsigned i)
+{
+    return "layer_" + boost::lexical_cast<std::string>(i);
+}
+
+static std::string class_name(unsigned i)
+{
+    return "class_" + boost::lexical_cast<std::string>(i);
+}
+
+static std::string stylesheet_name(unsigned i)
+{
+    return "style_" + boost::lexical_cast<std::string>(i) + ".mss";
+}
+
+static void write_mml(std::ostream& out, project_options const& options)
+{
+    std::string const srs = "+proj=merc +a=6378137 +b=6378137 +lat_ts=0.0 +lon_0=0.0 +x_0=0.0 +y_0=0 "
+                            "+k=1.0 +units=m +nadgrids=@null +wktext +no_defs +over";
+
+    out << "{\n    \"srs\": \"" << srs << "\",\n    \"Stylesheet\": [";
+    for (unsigned s = 0; s < options.stylesheets; ++s)
+        out << (s ? ", " : "") << "\"" << stylesheet_name(s) << "\"";
+    out << "],\n    \"Layer\": [";
+
+    for (unsigned i = 0; i < options.layers; ++i) {
+        out << (i ? ",\n" : "\n")
+            << "        {\n"
+            << "            \"id\": \"" << layer_name(i) << "\",\n"
+            << "            \"name\": \"" << layer_name(i) << "\",\n";
+        if (options.classes)
+            out << "            \"class\": \"" << class_name(i % options.classes) << "\",\n";
+        out << "            \"srs\": \"" << srs << "\",\n"
+            << "            \"Datasource\": {\"type\": \"shape\", \"file\": \"" << layer_name(i) << ".shp\"}\n"
+            << "        }";
+    }
+
+    out << "\n    ]\n}\n";
+}
+
+static bool write_file(fs::path const& path, std::string const& content)
+{
+    std::ofstream file(path.string().c_str());
+    if (!file.is_open()) {
+        std::cout << "Error: could not write " << path.string() << "\n";
+        return false;
+    }
+    file << content;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    project_options options;
+    std::string directory;
+
+    std::map<std::string, unsigned*> flags;
+    flags["--layers"] = &options.layers;
+    flags["--rules"] = &options.rules;
+    flags["--depth"] = &options.depth;
+    flags["--zooms"] = &options.zooms;
+    flags["--variables"] = &options.variables;
+    flags["--expression"] = &options.expression;
+    flags["--cardinality"] = &options.cardinality;
+    flags["--stylesheets"] = &options.stylesheets;
+    flags["--classes"] = &options.classes;
+    flags["--seed"] = &options.seed;
+
+    for (int i = 1; i < argc; ++i) {
+        std::map<std::string, unsigned*>::iterator flag = flags.find(argv[i]);
+        if (flag != flags.end() && i + 1 < argc)
+            *flag->second = boost::lexical_cast<unsigned>(argv[++i]);
+        else
+            directory = argv[i];
+    }
+
+    if (directory.empty() || options.stylesheets == 0) {
+        std::cout << "usage: synthetic_project [--layers N] [--rules M] [--depth D] [--zooms Z]\n"
+                  << "         [--variables P] [--expression K] [--cardinality C] [--stylesheets S]\n"
+                  << "         [--classes L] [--seed X] directory\n";
+        return EXIT_FAILURE;
+    }
+
+    fs::create_directories(directory);
+
+    random_source random(options.seed);
+    stylesheet_writer writer(options, random);
+    std::vector<std::ostringstream*> sheets;
+    for (unsigned s = 0; s < options.stylesheets; ++s)
+        sheets.push_back(new std::ostringstream());
+
+    std::ostringstream& first = *sheets[0];
+    first << "Map {\n  background-color: #b8dee6;\n}\n\n";
+
+    for (unsigned i = 0; i < options.layers; ++i) {
+        std::ostream& out = *sheets[i % options.stylesheets];
+        for (unsigned r = 0; r < options.rules; ++r)
+            writer.write_block(out, "#" + layer_name(i), options.depth, "");
+        out << "\n";
+    }
+
+    for (unsigned c = 0; c < options.classes; ++c)
+        writer.write_block(first, "." + class_name(c), options.depth, "");
+
+    bool written = true;
+    for (unsigned s = 0; s < options.stylesheets; ++s) {
+        // each stylesheet can use any variable, so all go in front of the first
+        std::string content = s ? sheets[s]->str() : writer.variables() + "\n" + sheets[s]->str();
+        written = write_file(fs::path(directory) / stylesheet_name(s), content) && written;
+        delete sheets[s];
+    }
+
+    std::ostringstream mml;
+    write_mml(mml, options);
+    written = write_file(fs::path(directory) / "project.mml", mml.str()) && written;
+
+    return written ? 0 : EXIT_FAILURE;
+}